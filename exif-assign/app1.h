@@ -1,22 +1,38 @@
 #include<vector>
 #include<iostream>
+#include<cstring>
 
 // EXIF/TIFF Tags
-unsigned char exifIFDTag[2] = {0x87, 0x69};
-unsigned char apertureIFDTag[2] = {0x82, 0x9D};
-unsigned char shutterSpeedIFDTag[2] = {0x82, 0x9A};
+const unsigned short exifIFDTag = 0x8769;
+const unsigned short apertureIFDTag = 0x829D;
+const unsigned short shutterSpeedIFDTag = 0x829A;
+const unsigned short compressionTag = 0x0103;
+const unsigned short xResolutionTag = 0x011A;
+const unsigned short yResolutionTag = 0x011B;
+const unsigned short resolutionUnitTag = 0x0128;
+const unsigned short jpegInterchangeFormatTag = 0x0201;			// Offset of IFD1 thumbnail
+const unsigned short jpegInterchangeFormatLengthTag = 0x0202;	// Length of IFD1 thumbnail
+const unsigned short jpegCompression = 6;						// Compression value of a JPEG thumbnail
+const unsigned int thumbnailResolution = 72;					// Pixels per resolution unit of a thumbnail
+const unsigned short inchResolutionUnit = 2;					// ResolutionUnit value for inches
+
+// TIFF Types
+const unsigned short shortType = 0x0003;		// Type 3 = uint16
+const unsigned short longType = 0x0004;			// Type 4 = uint32
+const unsigned short rationalType = 0x0005;		// Type 5 = rational (2 * uint32)
 
 // IFD
-unsigned char ifdOffset[4] = {0x00, 0x00, 0x00, 0x00};
+const unsigned int ifdOffset = 0x00000000;
 
 // APP1 Header
+const unsigned int maxAPP1Size = 0xFFFF;		// Segment length is 2 bytes
 unsigned char app1Tag[2] = {0xFF, 0xE1};
 unsigned char exifID[6] = {0x45, 0x78, 0x69, 0x66, 0x00, 0x00};	// "Exif  "
 
 // TIFF Header
 unsigned char littleEndianID[2] = {0x49, 0x49};	// "II"
 unsigned char bigEndianID[2] = {0x4D, 0x4D};	// "MM"
-unsigned char tiffID[2] = {0x00, 0x2A};			// 42
+const unsigned short tiffID = 0x002A;			// 42
 
 using namespace std;
 
@@ -55,104 +71,136 @@ void prettyPrintAPP1(unsigned char arr[], int len){
 	}
 }
 
-// Converts unsigned integer to byte array
-// Must create an byte[4] buffer where byte array is needed
-void uintToByteArray(unsigned int i, unsigned char* bytes){
-	bytes[0] = (i >> 24) & 0xFF;
-	bytes[1] = (i >> 16) & 0xFF;
-	bytes[2] = (i >> 8) & 0xFF;
-	bytes[3] = i & 0xFF;
-}
-
-// Converts byte array of size 4 to unsigned int
-unsigned int byteToUInt(unsigned char bytes[]){
-	return (	(bytes[0] << 24) |
-				(bytes[1] << 16) |
-				(bytes[2] << 8) |
-				bytes[3]);
-}
+// Byte order policy for encoding TIFF values
+// If the byte order matches the host, values are copied directly (memcpy); otherwise
+// they are byte swapped first
+template<bool littleEndian>
+struct ByteOrder{
+	static const bool native = (littleEndian == (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__));
+	
+	// Returns the TIFF header ID ("II" or "MM")
+	static unsigned char* id(){
+		return littleEndian ? littleEndianID : bigEndianID;
+	}
+	
+	// Converts unsigned short to byte array of size 2
+	static void fromUShort(unsigned short s, unsigned char* bytes){
+		if(!native)
+			s = __builtin_bswap16(s);
+		memcpy(bytes, &s, 2);
+	}
+	
+	// Converts unsigned int to byte array of size 4
+	static void fromUInt(unsigned int i, unsigned char* bytes){
+		if(!native)
+			i = __builtin_bswap32(i);
+		memcpy(bytes, &i, 4);
+	}
+	
+	// Converts byte array of size 2 to unsigned short
+	static unsigned short toUShort(const unsigned char bytes[]){
+		unsigned short s;
+		memcpy(&s, bytes, 2);
+		return native ? s : __builtin_bswap16(s);
+	}
+	
+	// Converts byte array of size 4 to unsigned int
+	static unsigned int toUInt(const unsigned char bytes[]){
+		unsigned int i;
+		memcpy(&i, bytes, 4);
+		return native ? i : __builtin_bswap32(i);
+	}
+	
+	// Converts array of unsigned ints to bytes; a single copy if the byte order is native
+	static void fromUIntArray(const unsigned int arr[], int len, unsigned char* bytes){
+		if(native)
+			memcpy(bytes, arr, len * 4);
+		else
+			for(int i = 0; i < len; i++)
+				fromUInt(arr[i], bytes + (i * 4));
+	}
+};
 
-// Converts byte array of size 2 to unsigned short
-unsigned short byteToUShort(unsigned char bytes[]){
-	return (bytes[0] << 8) | bytes[1];
-}
+typedef ByteOrder<true> LittleEndian;	// "II"
+typedef ByteOrder<false> BigEndian;		// "MM"; JPEG markers and segment lengths are always big-endian
 
 class IFDField{
+	// Members are laid out in TIFF field order (12 bytes, no padding), so an array of
+	// fields can be copied directly when the byte order is native
 	private:
-		unsigned char tagID[2];
-		unsigned char typeID[2];
-		unsigned char count[4];
-		unsigned char value[4];
-		
+		unsigned short tagID;
+		unsigned short typeID;
+		unsigned int count;
+		unsigned int value;
+	
 	public:
-		// Return field as a vector of bytes
-		vector<unsigned char> get(){
-			vector<unsigned char> field;
-			
-			// Add field elements to vector
-			for(int i = 0; i < 2; i++)
-				field.push_back(tagID[i]);
-			
-			for(int i = 0; i < 2; i++)
-				field.push_back(typeID[i]);
-			
-			for(int i = 0; i < 4; i++)
-				field.push_back(count[i]);
-			
-			for(int i = 0; i < 4; i++)
-				field.push_back(value[i]);
-				
-			return field;
+		// Writes field (12 bytes) to byte array in the given byte order
+		template<class Order>
+		void get(unsigned char bytes[]){
+			Order::fromUShort(tagID, bytes);
+			Order::fromUShort(typeID, bytes + 2);
+			Order::fromUInt(count, bytes + 4);
+			
+			// SHORT values are stored in the first 2 bytes of the value field
+			if(typeID == shortType){
+				Order::fromUShort(value, bytes + 8);
+				memset(bytes + 10, 0, 2);
+			}
+			else{
+				Order::fromUInt(value, bytes + 8);
+			}
 		}
 		
 		// Set field Tag ID
-		void setTagID(unsigned char newTag[]){
-			memcpy(tagID, newTag, 2);
+		void setTagID(unsigned short newTag){
+			tagID = newTag;
 		}
 		
 		// Set field Type ID
-		void setTypeID(unsigned char newType[]){
-			memcpy(typeID, newType, 2);
+		void setTypeID(unsigned short newType){
+			typeID = newType;
 		}
 		
 		// Sets field component count
-		void setCount(unsigned char newCount[]){
-			memcpy(count, newCount, 4);
+		void setCount(unsigned int newCount){
+			count = newCount;
 		}
 		
 		// Sets field value or offset (from beginning of TIFF header)
-		void setValue(unsigned char newValue[]){
-			memcpy(value, newValue, 4);
+		void setValue(unsigned int newValue){
+			value = newValue;
 		}
 		
 		// Returns the value
-		unsigned char* getValue(){
+		unsigned int getValue(){
 			return value;
 		}
 		
 		// Checks if this field has tagID
-		bool isTag(unsigned char id[]){
-			if(tagID[0] == id[0] && tagID[1] == id[1])
-				return true;
-			
-			return false;
+		bool isTag(unsigned short id){
+			return tagID == id;
+		}
+		
+		// Checks if this field has typeID
+		bool isType(unsigned short id){
+			return typeID == id;
 		}
 };
 
+static_assert(sizeof(IFDField) == 12, "IFDField must match the 12 byte TIFF field layout");
+
 class IFDFieldWithData : public IFDField{
 	private:
-		vector<unsigned char> data;
+		vector<unsigned int> data;	// Data area is stored in 4-byte (uint32) units
 	
 	public:
-		// Adds byte array to data vector
-		void setData(unsigned char newData[], int dataLength){
-			for(int i = 0; i < dataLength; i++){
-				data.push_back(newData[i]);
-			}
+		// Adds unsigned int to data vector
+		void setData(unsigned int newData){
+			data.push_back(newData);
 		}
 		
 		// Returns the data vector
-		vector<unsigned char> getData(){
+		vector<unsigned int> getData(){
 			return data;
 		}
 };
@@ -162,207 +210,113 @@ class ExifIFDField : public IFDField{
 		// Creates a IFD field for the ExifIFD offset
 		// Field value (the actual offset needs to be calculated and set via IFDField method)
 		ExifIFDField(){
-			unsigned char type[2] = {0x00, 0x04};
-			unsigned char count[4] = {0x00, 0x00, 0x00, 0x01};
-			
 			setTagID(exifIFDTag);
-			setTypeID(type);
-			setCount(count);
-			unsigned char empty[] = {0x00, 0x00, 0x00, 0x00};
-			setValue(empty);
+			setTypeID(longType);
+			setCount(1);
+			setValue(0);
 		}
 };
 
-class ApertureIFDField : public IFDFieldWithData{
-	private:
-		unsigned char apertureNumerator[4];
-		unsigned char apertureDenominator[4];
-	
+class ShortIFDField : public IFDField{
+	public:
+		// Creates a IFD field with a single SHORT value
+		ShortIFDField(unsigned short tag, unsigned short value){
+			setTagID(tag);
+			setTypeID(shortType);
+			setCount(1);
+			setValue(value);
+		}
+};
+
+class LongIFDField : public IFDField{
+	public:
+		// Creates a IFD field with a single LONG value (or offset)
+		LongIFDField(unsigned short tag, unsigned int value){
+			setTagID(tag);
+			setTypeID(longType);
+			setCount(1);
+			setValue(value);
+		}
+};
+
+class RationalIFDField : public IFDFieldWithData{
 	public:
-		// Creates an aperture IFD field for the EXIF IFD and adds aperture information
+		// Creates a rational IFD field for the EXIF IFD and adds numerator/denominator
 		// to the data area
 		// Offset needs to be calculated before field is added to IFD, then set after
 		// the field is added using IFDFieldWithData.setValue()
-		ApertureIFDField(int aperture){
-			unsigned char type[2] = {0x00, 0x05};				// Type 5 = rational
-			unsigned char count[4] = {0x00, 0x00, 0x00, 0x01};	// Count = 1
+		RationalIFDField(unsigned short tag, unsigned int numerator, unsigned int denominator){
+			setTagID(tag);
+			setTypeID(rationalType);
+			setCount(1);
 			
-			setTagID(apertureIFDTag);
-			setTypeID(type);
-			setCount(count);
-			setApertureData(aperture);
+			// Add numerator/denominator to data field
+			setData(numerator);
+			setData(denominator);
 		}
-		
+};
+
+class ApertureIFDField : public RationalIFDField{
+	public:
 		// Aperture is stored in XML as integer = (f-stop * 10)
 		// eg. f/1.4 stored as 14
 		// Aperture is stored in IFD data area as numerator/denominator = (XML-value)/10
-		void setApertureData(int aperture){
-			// Denominator is always 10
-			unsigned char denom[4] = {0x00, 0x00, 0x00, 0x0A};
-			memcpy(apertureDenominator, denom, 4);
-			
-			// Numerator is f-stop * 10
-			apertureNumerator[0] = 0x00;
-			apertureNumerator[1] = 0x00;
-			apertureNumerator[2] = 0x00;
-			
-			// Switch recognizes full f-stops
-			switch(aperture){
-				case 14:
-					apertureNumerator[3] = 0x0E;
-					break;
-				case 20:
-					apertureNumerator[3] = 0x14;
-					break;
-				case 28:
-					apertureNumerator[3] = 0x1C;
-					break;
-				case 40:
-					apertureNumerator[3] = 0x28;
-					break;
-				case 56:
-					apertureNumerator[3] = 0x38;
-					break;
-				case 80:
-					apertureNumerator[3] = 0x50;
-					break;
-				case 110:
-					apertureNumerator[3] = 0x6E;
-					break;
-				case 160:
-					apertureNumerator[3] = 0xA0;
-					break;
-				case 220:
-					apertureNumerator[3] = 0xDC;
-					break;
-			}
-			
-			// Add numerator/denominator to data field
-			setData(apertureNumerator, 4);
-			setData(apertureDenominator, 4);	
-		}
+		ApertureIFDField(int aperture) : RationalIFDField(apertureIFDTag, aperture, 10){}
 };
 
-class ShutterSpeedIFDField : public IFDFieldWithData{
-	private:
-		unsigned char shutterSpeedNumerator[4];
-		unsigned char shutterSpeedDenominator[4];
-	
+class ShutterSpeedIFDField : public RationalIFDField{
 	public:
-		// Creates a shutter speed IFD field for the EXIF IFD and adds shutter
-		// speed information to the data area
-		// Offset needs to be calculated before field is added to IFD, then set after
-		// the field is added using IFDFieldWithData.setValue()
-		ShutterSpeedIFDField(int shutterSpeed){
-			unsigned char type[2] = {0x00, 0x05};				// Type 5 = rational
-			unsigned char count[4] = {0x00, 0x00, 0x00, 0x01};	// Count = 1
-			
-			setTagID(shutterSpeedIFDTag);
-			setTypeID(type);
-			setCount(count);
-			setShutterSpeedData(shutterSpeed);
-		}
-		
-		// Shutter speed is stored in XML as integer = (time in seconds) * 1000
-		// eg. 1/8 is stored as (0.125 * 1000) = 125
+		// Shutter speed is stored in XML as integer = (denominator of time in seconds) * 10
+		// eg. 1/8 is stored as (8 * 10) = 80
 		// Shutter speed is stored in IFD data area as numerator/denominator = 10 / (XML-value)
-		void setShutterSpeedData(int shutterSpeed){
-			// Numerator is always 10
-			unsigned char numer[4] = {0x00, 0x00, 0x00, 0x0A};
-			memcpy(shutterSpeedNumerator, numer, 4);
-			
-			// Convert XML shutter speed from int to hex
-			shutterSpeedDenominator[0] = 0x00;
-			shutterSpeedDenominator[1] = 0x00;
-			shutterSpeedDenominator[2] = 0x00;
-			
-			// Standard shutter speeds from 1/1000s to 1s are recognized
-			switch(shutterSpeed){
-				case 10000:
-					shutterSpeedDenominator[2] = 0x27;
-					shutterSpeedDenominator[3] = 0x10;
-					break;
-				case 5000:
-					shutterSpeedDenominator[2] = 0x13;
-					shutterSpeedDenominator[3] = 0x88;
-					break;
-				case 2500:
-					shutterSpeedDenominator[2] = 0x09;
-					shutterSpeedDenominator[3] = 0xC4;
-					break;
-				case 1250:
-					shutterSpeedDenominator[2] = 0x04;
-					shutterSpeedDenominator[3] = 0xE2;
-					break;
-				case 600:
-					shutterSpeedDenominator[2] = 0x02;
-					shutterSpeedDenominator[3] = 0x58;
-					break;
-				case 300:
-					shutterSpeedDenominator[2] = 0x01;
-					shutterSpeedDenominator[3] = 0x2C;
-					break;
-				case 150:
-					shutterSpeedDenominator[3] = 0x96;
-					break;
-				case 80:
-					shutterSpeedDenominator[3] = 0x50;
-					break;
-				case 40:
-					shutterSpeedDenominator[3] = 0x28;
-					break;
-				case 20:
-					shutterSpeedDenominator[3] = 0x14;
-					break;
-				case 10:
-					shutterSpeedDenominator[3] = 0x0A;
-					break;
-			}
-			
-			// Add numerator/denominator to data field
-			setData(shutterSpeedNumerator, 4);
-			setData(shutterSpeedDenominator, 4);
-		}
+		ShutterSpeedIFDField(int shutterSpeed) : RationalIFDField(shutterSpeedIFDTag, 10, shutterSpeed){}
 };
 
 class IFD{
 	private:
 		unsigned short numFields;		// ushort (2 bytes) so it can be incremented
 		vector<IFDField> fields;
-		unsigned char offsetNextIFD[4];
-		vector<unsigned char> dataArea;
-		
+		unsigned int offsetNextIFD;
+		vector<unsigned int> dataArea;
+	
 	public:
 		// Constructor
 		IFD(){
 			// Set offset to next IFD to default (const 0x0000 0000)
 			numFields = 0x0000;
-			memcpy(offsetNextIFD, ifdOffset, 4);
+			offsetNextIFD = ifdOffset;
 		}
 		
-		// Returns entire IFD as a vector of bytes
-		vector<unsigned char> get(){
-			vector<unsigned char> ifdBytes;
+		// Appends entire IFD to a vector of bytes in the given byte order
+		template<class Order>
+		void get(vector<unsigned char>& ifdBytes){
+			size_t start = ifdBytes.size();
+			ifdBytes.resize(start + getSize());
+			unsigned char* bytes = ifdBytes.data() + start;
 			
 			// Add numFields as bytes
-			ifdBytes.push_back((numFields >> 8) & 0xFF);
-			ifdBytes.push_back(numFields & 0xFF);
-			
-			// Add each field
-			for(int i = 0; i < fields.size(); i++){
-				vector<unsigned char> field = fields.at(i).get();
-				ifdBytes.insert(end(ifdBytes), begin(field), end(field));
+			Order::fromUShort(numFields, bytes);
+			bytes += 2;
+			
+			// Add each field; the field array is copied directly if the byte order is native
+			// (SHORT values only match the copied uint32 on little-endian hosts, so they are rewritten)
+			if(Order::native){
+				memcpy(bytes, fields.data(), fields.size() * 12);
+				for(int i = 0; i < fields.size(); i++)
+					if(fields.at(i).isType(shortType))
+						fields.at(i).get<Order>(bytes + (i * 12));
 			}
+			else
+				for(int i = 0; i < fields.size(); i++)
+					fields.at(i).get<Order>(bytes + (i * 12));
+			bytes += fields.size() * 12;
 			
 			// Add offset to next IFD
-			for(int i = 0; i < 4; i++){
-				ifdBytes.push_back(offsetNextIFD[i]);
-			}
+			Order::fromUInt(offsetNextIFD, bytes);
+			bytes += 4;
 			
 			// Add data area
-			ifdBytes.insert(end(ifdBytes), begin(dataArea), end(dataArea));
-			
-			return ifdBytes;
+			Order::fromUIntArray(dataArea.data(), dataArea.size(), bytes);
 		}
 		
 		// Adds a new IFD field
@@ -377,13 +331,9 @@ class IFD{
 			numFields++;
 			fields.push_back(newField);
 			
-			// Retrieve data byte array and size
-			vector<unsigned char> data = newField.getData();
-			
-			// Add each byte of field data to data area
-			for(int i = 0; i < data.size(); i++){
-				dataArea.push_back(data.at(i));
-			}
+			// Add field data to data area
+			vector<unsigned int> data = newField.getData();
+			dataArea.insert(end(dataArea), begin(data), end(data));
 			
 			updateOffsets();
 		}
@@ -395,24 +345,23 @@ class IFD{
 			for(int i = 0; i < fields.size() - 1; i++){
 				
 				// Checks if field value is an offset; adding a field changes this offset
-				if(	fields.at(i).isTag(exifIFDTag) || 
-					fields.at(i).isTag(apertureIFDTag) || 
+				if(	fields.at(i).isTag(exifIFDTag) ||
+					fields.at(i).isTag(apertureIFDTag) ||
 					fields.at(i).isTag(shutterSpeedIFDTag)){
 					
-					unsigned int newOffset = byteToUInt(fields.at(i).getValue());
-					newOffset += 12;	// New field adds 12 bytes
-					
-					// Convert newOffset back to byte array for writing
-					unsigned char newOffsetBytes[4];
-					uintToByteArray(newOffset, newOffsetBytes);
-					
-					fields.at(i).setValue(newOffsetBytes);		// Write new offset to field value
+					// New field adds 12 bytes
+					fields.at(i).setValue(fields.at(i).getValue() + 12);
 				}
 			}
 		}
 		
+		// Sets the offset to the next IFD (from beginning of TIFF header; 0 if this is the last IFD)
+		void setNextIFDOffset(unsigned int offset){
+			offsetNextIFD = offset;
+		}
+		
 		// Sets the value of a field by tagID
-		void setFieldValue(unsigned char tagID[], unsigned char newValue[]){
+		void setFieldValue(unsigned short tagID, unsigned int newValue){
 			for(int i = 0; i < fields.size(); i++){
 				// Updates value of field if found
 				if(fields.at(i).isTag(tagID)){
@@ -432,7 +381,7 @@ class IFD{
 			ifdSize += sizeof(numFields);
 			ifdSize += (numFields * 12);		// Each IFD field is 12 bytes long
 			ifdSize += sizeof(offsetNextIFD);
-			ifdSize += dataArea.size();
+			ifdSize += dataArea.size() * 4;
 			
 			return ifdSize;
 		}
@@ -451,9 +400,9 @@ class APP1Header{
 		}
 		
 		// Sets the APP1 size bytes ((APP1 headers - 0xFFE1 marker) + IFD0 + EXIF IFD)
+		// Segment size is part of the JPEG, so it is always big-endian
 		void setSize(short newSize){
-			size[0] = (newSize >> 8) & 0xFF;
-			size[1] = newSize & 0xFF;
+			BigEndian::fromUShort(newSize, size);
 		}
 		
 		// Returns the length of the APP1 header
@@ -471,29 +420,28 @@ class APP1Header{
 				header.push_back(size[i]);
 			for(int i = 0; i < 6; i++)
 				header.push_back(exifMarker[i]);
-				
+			
 			return header;
 		}
 };
 
 class TIFFHeader{
 	private:
-		unsigned char endianess[2];
-		unsigned char tiffMarker[2];
-		unsigned char offset0IFD[4];
+		short endianess;
+		unsigned short tiffMarker;
+		unsigned int offset0IFD;
 	
 	public:
 		// Constructor; arg for endianess (0 for little, 1 for big)
 		TIFFHeader(short end){
-			if(end == 0)
-				memcpy(endianess, littleEndianID, 2);
-			else if(end == 1)
-				memcpy(endianess, bigEndianID, 2);
-				
-			memcpy(tiffMarker, tiffID, 2);
-			
-			unsigned char eightBytesOffset[4] = {0x00, 0x00, 0x00, 0x08};	// 8 byte offset to 0th IFD
-			memcpy(offset0IFD, eightBytesOffset, 4);
+			endianess = end;
+			tiffMarker = tiffID;
+			offset0IFD = 0x00000008;	// 8 byte offset to 0th IFD
+		}
+		
+		// Returns true if the TIFF header is little-endian
+		bool isLittleEndian(){
+			return endianess == 0;
 		}
 		
 		// Returns the length of the TIFF header
@@ -501,18 +449,16 @@ class TIFFHeader{
 			return 0x0008;	// 2 + 2 + 4 = 8 = 0x8
 		}
 		
-		// Returns the TIFF header as a vector of bytes
-		vector<unsigned char> get(){
-			vector<unsigned char> header;
+		// Appends the TIFF header to a vector of bytes in the given byte order
+		template<class Order>
+		void get(vector<unsigned char>& header){
+			unsigned char bytes[8];
 			
-			for(int i = 0; i < 2; i++)
-				header.push_back(endianess[i]);
-			for(int i = 0; i < 2; i++)
-				header.push_back(tiffMarker[i]);
-			for(int i = 0; i < 4; i++)
-				header.push_back(offset0IFD[i]);
-				
-			return header;
+			memcpy(bytes, Order::id(), 2);
+			Order::fromUShort(tiffMarker, bytes + 2);
+			Order::fromUInt(offset0IFD, bytes + 4);
+			
+			header.insert(end(header), bytes, bytes + 8);
 		}
 };
 
@@ -522,46 +468,73 @@ class APP1{
 		TIFFHeader* tiffHeader;
 		IFD ifd0;
 		IFD exifIFD;
+		IFD ifd1;							// Thumbnail IFD (only written if there is a thumbnail)
+		vector<unsigned char> thumbnail;	// JPEG thumbnail, after IFD1
+		
+		// Writes TIFF header and IFDs after the APP1 header in the given byte order
+		template<class Order>
+		void getTIFF(vector<unsigned char>& app1Vector){
+			tiffHeader->get<Order>(app1Vector);
+			ifd0.get<Order>(app1Vector);
+			exifIFD.get<Order>(app1Vector);
+			if(!thumbnail.empty()){
+				ifd1.get<Order>(app1Vector);
+				app1Vector.insert(end(app1Vector), begin(thumbnail), end(thumbnail));
+			}
+		}
 		
+		// Creates IFD1 at ifd1Offset (from the TIFF header) for a thumbnail of the given length,
+		// which follows IFD1
+		// Exif requires the resolution fields for a JPEG thumbnail; fields are in tag order
+		IFD createThumbnailIFD(unsigned int ifd1Offset, unsigned int length){
+			IFD thumbnailIFD;
+			thumbnailIFD.addField(ShortIFDField(compressionTag, jpegCompression));
+			thumbnailIFD.addField(RationalIFDField(xResolutionTag, thumbnailResolution, 1));
+			thumbnailIFD.addField(RationalIFDField(yResolutionTag, thumbnailResolution, 1));
+			thumbnailIFD.addField(ShortIFDField(resolutionUnitTag, inchResolutionUnit));
+			thumbnailIFD.addField(LongIFDField(jpegInterchangeFormatTag, 0));
+			thumbnailIFD.addField(LongIFDField(jpegInterchangeFormatLengthTag, length));
+			
+			// Data area (X then Y resolution) follows numFields, the 6 fields and the next IFD offset
+			unsigned int dataOffset = ifd1Offset + 2 + (6 * 12) + 4;
+			thumbnailIFD.setFieldValue(xResolutionTag, dataOffset);
+			thumbnailIFD.setFieldValue(yResolutionTag, dataOffset + 8);
+			thumbnailIFD.setFieldValue(jpegInterchangeFormatTag, ifd1Offset + thumbnailIFD.getSize());
+			return thumbnailIFD;
+		}
+	
 	public:
 		// Creates a new APP1 object with the following:
 		// APP1 header
-		// TIFF header set to big-endian
+		// TIFF header set to arg endianess (0 for little, 1 for big; big-endian by default)
 		// IFD0 (with EXIF Offset field, pointing to EXIF IFD)
 		// EXIF IFD (with no fields)
-		APP1(){
+		APP1(short end = 1){
 			app1Header = new APP1Header();
-			tiffHeader = new TIFFHeader(1);	// 1 for big-endian
+			tiffHeader = new TIFFHeader(end);
 			
 			// Add EXIF Offset field to IFD0, and set the value
 			ifd0.addField(ExifIFDField());
 			
-			unsigned char intBuffer[4];	// Buffer for int conversion
 			unsigned int exifOffset = tiffHeader->getSize() + ifd0.getSize();
-			uintToByteArray(exifOffset, intBuffer);
-			ifd0.setFieldValue(exifIFDTag, intBuffer);
+			ifd0.setFieldValue(exifIFDTag, exifOffset);
 		}
 		
 		// Returns entire APP1 segment as byte array
 		void get(unsigned char bytes[]){
 			updateSegSize();
 			vector<unsigned char> app1Vector;
+			app1Vector.reserve(getSize());
 			
 			// Add APP1 header
 			vector<unsigned char> app1HeaderBytes = app1Header->get();
 			app1Vector.insert(end(app1Vector), begin(app1HeaderBytes), end(app1HeaderBytes));
 			
-			// Add TIFF header
-			vector<unsigned char> tiffHeaderBytes = tiffHeader->get();
-			app1Vector.insert(end(app1Vector), begin(tiffHeaderBytes), end(tiffHeaderBytes));
-			
-			// Add 0IFD
-			vector<unsigned char> ifd0Bytes = ifd0.get();
-			app1Vector.insert(end(app1Vector), begin(ifd0Bytes), end(ifd0Bytes));
-			
-			// Add EXIF IFD
-			vector<unsigned char> exifBytes = exifIFD.get();
-			app1Vector.insert(end(app1Vector), begin(exifBytes), end(exifBytes));
+			// Add TIFF header, 0IFD and EXIF IFD
+			if(tiffHeader->isLittleEndian())
+				getTIFF<LittleEndian>(app1Vector);
+			else
+				getTIFF<BigEndian>(app1Vector);
 			
 			copy(app1Vector.begin(), app1Vector.end(), bytes);
 		}
@@ -571,8 +544,8 @@ class APP1{
 			app1Header->setSize(getSize() - 2);	// Subtract the APP1 marker (0xFFE1)
 		}
 		
-		// Get size of entire APP1 (APP1 headers, IFD0, EXIF IFD) in 
-		// bytes (including APP1 marker)
+		// Get size of entire APP1 (APP1 headers, IFD0, EXIF IFD, and IFD1 and thumbnail if
+		// added) in bytes (including APP1 marker)
 		unsigned short getSize(){
 			unsigned short size = 0x0000;
 			
@@ -580,6 +553,8 @@ class APP1{
 			size += tiffHeader->getSize();
 			size += ifd0.getSize();
 			size += exifIFD.getSize();
+			if(!thumbnail.empty())
+				size += ifd1.getSize() + thumbnail.size();
 			
 			return size;
 		}
@@ -595,20 +570,118 @@ class APP1{
 		// Adds EXIF metadata to APP1 segment
 		// tagID - EXIF tag ID of the kind of metadata
 		// value - EXIF data defined by film-exif (see documentation)
-		void addMetadata(unsigned char tagID[], int value){
-			// Get offset to next available data area as byte array
-			unsigned char intBuffer[4];
-			uintToByteArray(getNextDataOffset(), intBuffer);
+		void addMetadata(unsigned short tagID, int value){
+			// Get offset to next available data area
+			unsigned int dataOffset = getNextDataOffset();
 			
 			// Add field to EXIF IFD corresponding to tagID, with arg value
-			if(	tagID[0] == apertureIFDTag[0] &&
-				tagID[1] == apertureIFDTag[1])
+			if(tagID == apertureIFDTag)
 				exifIFD.addField(ApertureIFDField(value));
-			else if(tagID[0] == shutterSpeedIFDTag[0] &&
-					tagID[1] == shutterSpeedIFDTag[1])
+			else if(tagID == shutterSpeedIFDTag)
 				exifIFD.addField(ShutterSpeedIFDField(value));
 			
 			// Set offset to point to correct data
-			exifIFD.setFieldValue(tagID, intBuffer);
+			exifIFD.setFieldValue(tagID, dataOffset);
+		}
+		
+		// Returns the largest thumbnail that can be added without exceeding the APP1 segment size
+		unsigned int getMaxThumbnailSize(){
+			return maxAPP1Size - getSize() - createThumbnailIFD(0, 0).getSize();
+		}
+		
+		// Adds a JPEG thumbnail in IFD1, which follows the EXIF IFD; the thumbnail follows IFD1
+		// Note: must be added after all metadata, since IFD1 is placed after the EXIF IFD
+		// Returns false if the thumbnail is too large (see getMaxThumbnailSize)
+		bool addThumbnail(vector<unsigned char> jpg){
+			if(!thumbnail.empty() || jpg.empty() || jpg.size() > getMaxThumbnailSize())
+				return false;
+			
+			// Offsets are calculated starting at the TIFF header
+			unsigned int ifd1Offset = getSize() - app1Header->getSize();
+			ifd1 = createThumbnailIFD(ifd1Offset, jpg.size());
+			ifd0.setNextIFDOffset(ifd1Offset);
+			thumbnail = jpg;
+			return true;
 		}
 };
+
+// Reads a rational from the data area of a TIFF field; returns false if the field is not
+// a rational or its data is outside of the TIFF bytes
+template<class Order>
+bool readTIFFRational(const unsigned char tiff[], size_t length, const unsigned char field[],
+		unsigned int& numerator, unsigned int& denominator){
+	unsigned int offset = Order::toUInt(field + 8);
+	if(Order::toUShort(field + 2) != rationalType || offset + 8 < offset || offset + 8 > length)
+		return false;
+	
+	numerator = Order::toUInt(tiff + offset);
+	denominator = Order::toUInt(tiff + offset + 4);
+	return numerator != 0 && denominator != 0;
+}
+
+// Reads aperture and shutter speed (as XML values) from the TIFF header and IFDs of an
+// APP1 segment in the given byte order; values that are not found are left unchanged
+template<class Order>
+bool readTIFF(const unsigned char tiff[], size_t length, int& aperture, int& shutterSpeed){
+	if(length < 8 || Order::toUShort(tiff + 2) != tiffID)
+		return false;
+	
+	// Find EXIF IFD offset in IFD0
+	unsigned int ifd0 = Order::toUInt(tiff + 4);
+	if(ifd0 + 2 < ifd0 || ifd0 + 2 > length)
+		return false;
+	unsigned int exifIFD = 0;
+	unsigned short numFields = Order::toUShort(tiff + ifd0);
+	for(unsigned int i = 0; i < numFields && ifd0 + 2 + (i + 1) * 12 <= length; i++){
+		const unsigned char* field = tiff + ifd0 + 2 + (i * 12);
+		if(Order::toUShort(field) == exifIFDTag)
+			exifIFD = Order::toUInt(field + 8);
+	}
+	if(exifIFD == 0 || exifIFD + 2 < exifIFD || exifIFD + 2 > length)
+		return false;
+	
+	// Read aperture and shutter speed fields in EXIF IFD
+	// Aperture = numerator/denominator = (XML-value)/10
+	// Shutter speed = numerator/denominator = 10/(XML-value)
+	bool found = false;
+	numFields = Order::toUShort(tiff + exifIFD);
+	for(unsigned int i = 0; i < numFields && exifIFD + 2 + (i + 1) * 12 <= length; i++){
+		const unsigned char* field = tiff + exifIFD + 2 + (i * 12);
+		unsigned int numerator, denominator;
+		if(!readTIFFRational<Order>(tiff, length, field, numerator, denominator))
+			continue;
+		
+		if(Order::toUShort(field) == apertureIFDTag){
+			aperture = (int)((numerator * 10.0) / denominator + 0.5);
+			found = true;
+		}
+		else if(Order::toUShort(field) == shutterSpeedIFDTag){
+			shutterSpeed = (int)((denominator * 10.0) / numerator + 0.5);
+			found = true;
+		}
+	}
+	
+	return found;
+}
+
+// Reads aperture and shutter speed (as XML values) from an APP1 segment, as produced by
+// APP1.get(); segment starts at the APP1 marker (0xFFE1)
+// Returns false if the segment is not Exif or has neither value
+bool readAPP1(const unsigned char segment[], size_t length, int& aperture, int& shutterSpeed){
+	APP1Header app1Header;
+	TIFFHeader tiffHeader(1);
+	size_t tiffStart = app1Header.getSize();
+	
+	if(	length < tiffStart + tiffHeader.getSize() ||
+		memcmp(segment, app1Tag, 2) != 0 ||
+		memcmp(segment + 4, exifID, 6) != 0)
+		return false;
+	
+	const unsigned char* tiff = segment + tiffStart;
+	if(memcmp(tiff, littleEndianID, 2) == 0)
+		return readTIFF<LittleEndian>(tiff, length - tiffStart, aperture, shutterSpeed);
+	else if(memcmp(tiff, bigEndianID, 2) == 0)
+		return readTIFF<BigEndian>(tiff, length - tiffStart, aperture, shutterSpeed);
+	
+	return false;
+}
@@ -4,8 +4,20 @@
 #include<vector>
 #include<dirent.h>
 #include<regex>
+#include<chrono>
+#include<thread>
+#include<atomic>
+#include<mutex>
 
 #include "app1.h"
+#include "xmp.h"
+#include "filecache.h"
+#include "scheduler.h"
+#include "undo.h"
+#include "index.h"
+#include "jpeg.h"
+#include "thumbnail.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -14,6 +26,30 @@ struct XmlFrame{
 	int shutterSpeed;
 };
 
+// Returns true if a frame has a recorded exposure; frames listed by extract without any
+// metadata have an aperture and shutter speed of 0
+bool isRecorded(XmlFrame frame){
+	return frame.aperture != 0 || frame.shutterSpeed != 0;
+}
+
+// Options set by command line flags (entered before the arguments)
+struct AssignOptions{
+	short endianess = 1;	// Byte order of the APP1 TIFF header (0 for little, 1 for big)
+	string tracePath;		// Chrome trace event JSON output (requires -DFILM_EXIF_TRACE)
+	CachePolicy cache;		// Read-ahead and page cache policy for image files
+	string indexPath;		// Index of assigned frames to update
+	int hddJobs = 1;		// Files read or written at once on each rotational disk
+	int ssdJobs = 4;		// Files read or written at once on each non-rotational disk
+	IOScheduler* scheduler = NULL;	// Limits reads and writes per device (NULL for no limit)
+	WriterPool* writers = NULL;		// Writes the outputs of a frame at the same time (NULL to write them in turn)
+	string undoLogPath;		// Undo log of overwritten files
+	int overwriteOutput = -1;	// Output directory that is the images directory (-1 if none)
+	UndoLog* undoLog = NULL;		// Open undo log (NULL if no file is overwritten)
+	bool verify = false;		// Check that the image data of each output matches its input
+	string reportPath;		// CSV report of every output written
+	bool thumbnail = false;		// Add a thumbnail (IFD1) made from the DC coefficients of the input
+};
+
 // Removes the leading whitespace before a line in XML file
 string removeLeadingWhitespace(string line){	
 	bool whitespace = true;
@@ -38,6 +74,7 @@ string removeXmlTags(string line, string tag){
 
 // Parse XML file into a vector of XmlFrame elements
 vector<XmlFrame> parseXml(string filepath){
+	TRACE_SCOPE("parseXml");
 	vector<XmlFrame> roll;
 	
 	ifstream xml(filepath);
@@ -76,75 +113,198 @@ vector<XmlFrame> parseXml(string filepath){
 	return roll;
 }
 
-// Creates a JPG from input JPG image data, and metadata generated from XmlFrame
-// Filepaths are assumed to be correct (checked in calling function)
-void writeMetadata(string inFilepath, string outFilepath, XmlFrame metadata){
-	// Open file streams
-	ifstream jpg(inFilepath, ios::binary);
-	fstream temp("./temp.jpg", ios::binary | ios::trunc | ios::in | ios::out);
-	
-	// Two-phase commit; copy input JPG to a temporary file
-	temp << jpg.rdbuf();
-	jpg.close();
-	
-	// Delete original JPG file if overwriting
-	if(inFilepath == outFilepath){
-		if(remove(inFilepath.c_str()) != 0)
-			perror("Error deleting file!\n");
-	}
+// Result of writing metadata for one input JPG
+struct WriteResult{
+	size_t bytesRead = 0;
+	vector<bool> written;	// Whether each output JPG was written
+	vector<char> mismatched;	// Whether each output JPG failed verification (--verify); not vector<bool>, since each is set by its own writer thread
+	unsigned long long inputDigest = 0;		// XXH3 hash of the input image data (--verify)
+	vector<unsigned long long> outputDigests;	// XXH3 hash of each output image data (--verify)
+};
+
+// Returns the XXH3 hash of the image data (SOS to end of file) of a JPG file, read back
+// from disk; returns false if the file could not be read
+// The file is memory mapped, so the (just written) pages are hashed without being copied
+bool hashImageData(string filepath, unsigned long long& digest){
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
 	
-	// Get input JPG filesize in bytes
-	int filesize = temp.tellg();
-	temp.seekg(0, ios::beg);		// Reset for reading
+	struct stat st;
+	void* map = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size > 0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return false;
 	
-	unsigned char buf[2];
+	JpegHeader header;
+	const unsigned char* jpg = (const unsigned char*)map;
+	bool valid = header.parse(jpg, st.st_size);
+	if(valid)
+		digest = xxh3Hash64(jpg + header.getSOSOffset(), st.st_size - header.getSOSOffset());
+	munmap(map, st.st_size);
+	return valid;
+}
+
+// Creates JPGs from input JPG image data, and metadata generated from XmlFrame
+// The input is read and parsed once; the same header and image data are then written to
+// every output filepath concurrently
+// Filepaths are assumed to be correct (checked in calling function)
+WriteResult writeMetadata(string inFilepath, vector<string> outFilepaths, XmlFrame metadata, AssignOptions options){
+	WriteResult result;
+	result.written.assign(outFilepaths.size(), false);
+	result.mismatched.assign(outFilepaths.size(), false);
+	result.outputDigests.assign(outFilepaths.size(), 0);
 	
-	ofstream jpgExif(outFilepath, ios::binary | ios::trunc);
-	// Read SOI (0xFFD8) from input JPG and write to output JPG
-	temp.read((char*)&buf, 2);
-	jpgExif.write((char*)buf, 2);
+	// Read input JPG into memory
+	FileBuffer jpg;
+	{
+		TRACE_FRAME("read", inFilepath);
+		DeviceSlots* slots = NULL;
+		if(options.scheduler != NULL)
+			slots = options.scheduler->acquireRead(inFilepath);
+		bool read = readFile(inFilepath, jpg, options.cache);
+		if(slots != NULL)
+			options.scheduler->release(slots);
+		if(!read){
+			perror("Could not read JPG file");
+			return result;
+		}
+	}
+	result.bytesRead = jpg.getSize();
 	
+	// Find the segments before the image data (SOS)
+	JpegHeader header;
+	if(!header.parse(jpg.getBytes(), jpg.getSize())){
+		printf("[ERROR] %s is not a valid JPG file\n", inFilepath.c_str());
+		return result;
+	}
 	
 	// Create APP1 segment with metadata
-	APP1 app1;
-	app1.addMetadata(apertureIFDTag, metadata.aperture);
-	app1.addMetadata(shutterSpeedIFDTag, metadata.shutterSpeed);
-	unsigned char appBytes[app1.getSize()];
-	app1.get(appBytes);		// APP1 segment exported to appBytes byte array for writing
+	vector<unsigned char> appBytes;
+	{
+		TRACE_FRAME("APP1", inFilepath);
+		APP1 app1(options.endianess);
+		app1.addMetadata(apertureIFDTag, metadata.aperture);
+		app1.addMetadata(shutterSpeedIFDTag, metadata.shutterSpeed);
+		
+		// Thumbnail is added last, since IFD1 follows the metadata
+		if(options.thumbnail){
+			TRACE_FRAME("thumbnail", inFilepath);
+			vector<unsigned char> thumbnail;
+			if(!createThumbnail(jpg.getBytes(), jpg.getSize(), header, thumbnail, app1.getMaxThumbnailSize()))
+				printf("[WARNING] No thumbnail for %s (only baseline JPG files are supported)\n", inFilepath.c_str());
+			else if(!app1.addThumbnail(thumbnail))
+				printf("[WARNING] No thumbnail for %s (the thumbnail is too large for the APP1 segment)\n", inFilepath.c_str());
+		}
+		
+		appBytes.resize(app1.getSize());
+		app1.get(appBytes.data());		// APP1 segment exported to appBytes byte array for writing
+	}
 	
+	// Record the original header of an overwritten input before it is replaced
+	// The input is not overwritten if its record could not be written
+	vector<int> errors(outFilepaths.size(), 0);		// errno of each output (0 if written)
+	for(int i = 0; i < outFilepaths.size() && options.undoLog != NULL; i++){
+		if(i == options.overwriteOutput && !options.undoLog->addRecord(inFilepath, jpg.getBytes(), jpg.getSize(), header.getSOSOffset()))
+			errors.at(i) = (errno != 0) ? errno : EIO;
+	}
 	
-	// Write generated APP1 to output JPG
-	jpgExif.write((char*)&appBytes, app1.getSize());
+	// Output is SOI (0xFFD8), the generated APP1, the input segments omitting any APPn
+	// segments, then the image data (SOS to end of file) unmodified
+	vector<ByteRange> ranges;
+	ranges.push_back({jpg.getBytes(), 2});
+	ranges.push_back({appBytes.data(), appBytes.size()});
+	vector<JpegSegment> segments = header.getSegments();
+	for(int i = 0; i < segments.size() - 1; i++){		// Last segment is SOS
+		if(!isAPPnMarker(segments.at(i).marker))
+			ranges.push_back({header.getSegmentBytes(segments.at(i)), segments.at(i).length + 2u});
+	}
+	ranges.push_back({jpg.getBytes() + header.getSOSOffset(), jpg.getSize() - header.getSOSOffset()});
 	
+	// Hash of the input image data, which every output must match
+	if(options.verify){
+		TRACE_FRAME("hash input", inFilepath);
+		result.inputDigest = xxh3Hash64(jpg.getBytes() + header.getSOSOffset(), jpg.getSize() - header.getSOSOffset());
+	}
 	
-	// Read input JPG in 2-byte chunks and writes it to output JPG, omitting any APPn segments
-	for(int i = 1; i < filesize; i+=2){	// Incremented by 2 since input JPG is read in 2-byte increments
-		temp.read((char*)&buf, 2);
+	// Write output JPGs; the outputs are written at the same time by the writer pool so that
+	// outputs on different disks are written at the same time
+	// Outputs are written to a temporary file first, so overwriting the input is safe
+	TRACE_FRAME("write", inFilepath);
+	auto writeOutput = [&](int i){
+		if(errors.at(i) != 0)
+			return;
 		
-		// Look for an APPn marker; denoting the beginning of an APPn segment
-		if(buf[0] == 0xFF && (buf[1] & 0xF0) == 0xE0){
-			temp.read((char*)&buf, 2);	// Read length of APPn segment
-			
-			// Skip through the APPn segment and omit writing segment to output JPG
-			// segLength is subtracted by 2 to remove the 2 bytes denoting length (was already read)
-			unsigned short segLength = byteToUShort(buf);
-			for(int x = 0; x < (segLength - 2); x++)
-				temp.read((char*)&buf, 1);
-		}
-		// No APPn marker; write to file
-		else{
-			jpgExif.write((char*)buf, 2);
-		}
+		DeviceSlots* slots = NULL;
+		if(options.scheduler != NULL)
+			slots = options.scheduler->acquireWrite(outFilepaths.at(i));
+		
+		// With --verify, each output is read back and hashed before it replaces its filepath
+		auto verifyOutput = [&](string tempFilepath){
+			TRACE_FRAME("verify output", outFilepaths.at(i));
+			bool read = hashImageData(tempFilepath, result.outputDigests.at(i));
+			result.mismatched.at(i) = !read || result.outputDigests.at(i) != result.inputDigest;
+			return !result.mismatched.at(i);
+		};
+		
+		TRACE_FRAME("write output", outFilepaths.at(i));
+		if(!writeFile(outFilepaths.at(i), ranges, options.verify ? function<bool(string)>(verifyOutput) : NULL))
+			errors.at(i) = (errno != 0) ? errno : EIO;
+		
+		if(slots != NULL)
+			options.scheduler->release(slots);
+	};
+	vector<function<void()>> writes;
+	for(int i = 0; i < outFilepaths.size(); i++)
+		writes.push_back([&writeOutput, i](){ writeOutput(i); });
+	if(options.writers != NULL){
+		options.writers->run(writes);
+	}
+	else{
+		for(int i = 0; i < writes.size(); i++)
+			writes.at(i)();
 	}
 	
-	// Close file streams
-	temp.close();
-	remove("./temp.jpg");
-	jpgExif.close();
+	// Per-output errors; the other outputs are still written
+	for(int i = 0; i < outFilepaths.size(); i++){
+		result.written.at(i) = (errors.at(i) == 0);
+		if(result.mismatched.at(i))
+			printf("[ERROR] Image data of %s does not match %s; not written\n", outFilepaths.at(i).c_str(), inFilepath.c_str());
+		else if(!result.written.at(i))
+			printf("[ERROR] Could not write %s: %s\n", outFilepaths.at(i).c_str(), strerror(errors.at(i)));
+		else if(options.cache.dontneed)
+			dropFileCache(outFilepaths.at(i));		// Drop finished output from the page cache
+	}
+	
+	return result;
+}
+
+// Returns the filepath of the XMP sidecar for a JPG (same name, ".xmp" extension)
+string sidecarFilepath(string jpgFilepath){
+	size_t extension = jpgFilepath.find_last_of('.');
+	return jpgFilepath.substr(0, extension) + ".xmp";
+}
+
+// Creates an XMP sidecar file from metadata generated from XmlFrame
+// The JPG itself is never opened, so only the (small) sidecar file is written
+// Like JPG outputs, the sidecar is written to a temporary file first, so an existing sidecar
+// is never left partially written; returns false if it could not be written
+bool writeSidecar(string outFilepath, XmlFrame metadata){
+	string xmp = xmpPacket(metadata.aperture, metadata.shutterSpeed);
+	vector<ByteRange> ranges;
+	ranges.push_back({(const unsigned char*)xmp.data(), xmp.size()});
+	if(!writeFile(outFilepath, ranges)){
+		printf("[ERROR] Could not write XMP sidecar %s: %s\n", outFilepath.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
 }
 
 // Returns a vector of filenames from a directory path
 vector<string> getFilenames(const char* path){
+	TRACE_SCOPE("getFilenames");
 	vector<string> filenames;
 	
 	DIR* dir;
@@ -170,26 +330,379 @@ vector<string> getFilenames(const char* path){
 	return filenames;
 }
 
+// Returns the name of a roll from its XML filepath (filename without extension)
+string rollName(string xmlFilepath){
+	size_t start = xmlFilepath.find_last_of('/') + 1;		// npos + 1 = 0 if there is no directory
+	size_t extension = xmlFilepath.find_last_of('.');
+	if(extension == string::npos || extension < start)
+		extension = xmlFilepath.length();
+	return xmlFilepath.substr(start, extension - start);
+}
+
+// Returns the canonical path of a file, so index entries do not depend on the working directory
+string canonicalFilepath(string filepath){
+	char* resolved = realpath(filepath.c_str(), NULL);
+	if(resolved == NULL)
+		return filepath;
+	
+	string canonical = resolved;
+	free(resolved);
+	return canonical;
+}
+
+// Prints the usage of the query subcommand
+void printQueryUsage(){
+	printf("Usage: query <index-filepath> [--aperture <value>] [--aperture-min <value>] [--aperture-max <value>]\n");
+	printf("\t[--shutter <value>] [--shutter-min <value>] [--shutter-max <value>] [--roll <name>]\n");
+	printf("Values are XML values (see documentation); eg. f/1.4 slower than 1/30s is --aperture 14 --shutter-max 299\n");
+}
+
+// Query subcommand; prints the frames in an index matching the filters
+// Usage: query <index-filepath> [filters]
+int queryIndex(int argc, char* argv[]){
+	if(argc < 3){
+		printQueryUsage();
+		return 0;
+	}
+	
+	// Parse filters; every filter takes a value
+	IndexQuery filter;
+	for(int arg = 3; arg < argc; arg += 2){
+		string option = argv[arg];
+		if(arg + 1 >= argc){
+			printf("Missing value for filter: %s\n", option.c_str());
+			printQueryUsage();
+			return 0;
+		}
+		unsigned int value = strtoul(argv[arg + 1], NULL, 10);
+		
+		if(option == "--aperture")
+			filter.apertureMin = filter.apertureMax = value;
+		else if(option == "--aperture-min")
+			filter.apertureMin = value;
+		else if(option == "--aperture-max")
+			filter.apertureMax = value;
+		else if(option == "--shutter")
+			filter.shutterSpeedMin = filter.shutterSpeedMax = value;
+		else if(option == "--shutter-min")
+			filter.shutterSpeedMin = value;
+		else if(option == "--shutter-max")
+			filter.shutterSpeedMax = value;
+		else if(option == "--roll")
+			filter.roll = argv[arg + 1];
+		else{
+			printf("Unknown filter: %s\n", option.c_str());
+			return 0;
+		}
+	}
+	
+	IndexFile index;
+	if(!index.open(argv[2])){
+		perror("Could not open index file");
+		return 1;
+	}
+	
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	vector<unsigned int> matches = index.query(filter);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	
+	const BlockSummary* summaries;
+	const unsigned int* apertures = index.getUIntColumn(apertureColumn, &summaries);
+	const unsigned int* shutterSpeeds = index.getUIntColumn(shutterSpeedColumn, &summaries);
+	for(int i = 0; i < matches.size(); i++){
+		unsigned int row = matches.at(i);
+		printf("%s\t%s\tf/%.1f\t1/%gs\n", index.getString(pathColumn, row).c_str(), index.getString(rollColumn, row).c_str(),
+			apertures[row] / 10.0, shutterSpeeds[row] / 10.0);
+	}
+	fprintf(stderr, "%lu of %u frames matched in %.3fms\n", matches.size(), index.getNumRows(), seconds * 1000);
+	
+	return 0;
+}
+
+// Metadata extracted from a JPG header
+struct ExtractedFrame{
+	bool found = false;
+	int aperture = 0;
+	int shutterSpeed = 0;
+	size_t bytesRead = 0;
+};
+
+// Reads aperture and shutter speed from the APP1 segments of a JPG
+// Only the header (SOI to SOS) is read, with small positioned reads
+ExtractedFrame extractMetadata(string filepath){
+	TRACE_FRAME("extract", filepath);
+	ExtractedFrame frame;
+	
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0){
+		perror("Could not open JPG file");
+		return frame;
+	}
+	
+	JpegHeader header;
+	header.read(fd);		// Segments before an invalid segment are still searched
+	frame.bytesRead = header.getBytesRead();
+	close(fd);
+	
+	vector<JpegSegment> segments = header.getSegments();
+	for(int i = 0; i < segments.size() && !frame.found; i++){
+		if(segments.at(i).marker == app1Tag[1])
+			frame.found = readAPP1(header.getSegmentBytes(segments.at(i)), segments.at(i).length + 2, frame.aperture, frame.shutterSpeed);
+	}
+	
+	return frame;
+}
+
+// Extract subcommand; prints the metadata of every JPG in a directory as XML (the format
+// read by parseXml) or CSV
+// Usage: extract [--csv] [--jobs <n>] <images-directory>
+int extractDirectory(int argc, char* argv[]){
+	bool csv = false;
+	int jobs = max(1u, thread::hardware_concurrency());
+	int arg = 2;
+	while(arg < argc && strncmp(argv[arg], "--", 2) == 0){
+		string option = argv[arg++];
+		
+		if(option == "--csv")
+			csv = true;
+		else if(option == "--jobs" && arg < argc)
+			jobs = max(1, atoi(argv[arg++]));
+		else{
+			printf("Unknown option: %s\n", option.c_str());
+			return 0;
+		}
+	}
+	if(arg != argc - 1){
+		printf("Usage: extract [--csv] [--jobs <n>] <images-directory>\n");
+		return 0;
+	}
+	string imgPath = argv[arg];
+	vector<string> filenames = getFilenames(imgPath.c_str());
+	
+	// Read headers in parallel; each thread takes the next file that has not been read
+	vector<ExtractedFrame> frames(filenames.size());
+	atomic<int> next(0);
+	vector<thread> workers;
+	for(int t = 0; t < jobs; t++){
+		workers.push_back(thread([&](){
+			for(int i = next++; i < filenames.size(); i = next++)
+				frames.at(i) = extractMetadata(imgPath + "/" + filenames.at(i));
+		}));
+	}
+	for(int t = 0; t < workers.size(); t++)
+		workers.at(t).join();
+	
+	// Print frames in filename order
+	size_t bytesRead = 0;
+	if(csv)
+		printf("filename,frameNumber,aperture,shutterSpeed\n");
+	else
+		printf("<roll>\n");
+	for(int i = 0; i < frames.size(); i++){
+		ExtractedFrame frame = frames.at(i);
+		bytesRead += frame.bytesRead;
+		
+		if(csv){
+			if(frame.found)
+				printf("%s,%d,%d,%d\n", filenames.at(i).c_str(), i, frame.aperture, frame.shutterSpeed);
+			else
+				printf("%s,%d,,\n", filenames.at(i).c_str(), i);
+		}
+		else{
+			// Frames are assigned to files by position, so a frame without metadata is kept as
+			// an unrecorded exposure (aperture and shutter speed 0), which is skipped when assigning
+			if(frame.found)
+				printf("\t<!-- %s -->\n", filenames.at(i).c_str());
+			else
+				printf("\t<!-- %s: no aperture or shutter speed found; skipped when assigning -->\n", filenames.at(i).c_str());
+			printf("\t<exp>\n");
+			printf("\t\t<frameNumber>%d</frameNumber>\n", i);
+			printf("\t\t<aperture>%d</aperture>\n", frame.aperture);
+			printf("\t\t<shutterSpeed>%d</shutterSpeed>\n", frame.shutterSpeed);
+			printf("\t</exp>\n");
+		}
+	}
+	if(!csv)
+		printf("</roll>\n");
+	
+	fprintf(stderr, "Read %lu bytes from %lu files (%lu bytes per file)\n", bytesRead, filenames.size(),
+		filenames.empty() ? 0 : bytesRead / filenames.size());
+	
+	return 0;
+}
+
+// Restores a file overwritten by a run from its undo log record
+// The current image data must be the data recorded when the file was overwritten; the
+// original file is then the recorded header followed by that data
+bool restoreFile(UndoRecord record){
+	FileBuffer jpg;
+	CachePolicy policy;
+	if(!readFile(record.path, jpg, policy)){
+		printf("[ERROR] Could not read %s: %s\n", record.path.c_str(), strerror(errno));
+		return false;
+	}
+	
+	JpegHeader header;
+	if(!header.parse(jpg.getBytes(), jpg.getSize())){
+		printf("[ERROR] %s is not a valid JPG file\n", record.path.c_str());
+		return false;
+	}
+	
+	const unsigned char* data = jpg.getBytes() + header.getSOSOffset();
+	size_t dataSize = jpg.getSize() - header.getSOSOffset();
+	if(dataSize != record.fileSize - record.header.size() || xxh3Hash64(data, dataSize) != record.fingerprint){
+		printf("[ERROR] Image data of %s has changed since it was overwritten; not restored\n", record.path.c_str());
+		return false;
+	}
+	
+	vector<ByteRange> ranges;
+	ranges.push_back({record.header.data(), record.header.size()});
+	ranges.push_back({data, dataSize});
+	if(!writeFile(record.path, ranges)){
+		printf("[ERROR] Could not write %s: %s\n", record.path.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Undo subcommand; restores the files overwritten by a run (-o) from its undo log
+// Usage: undo <undo-log>
+int undoRun(int argc, char* argv[]){
+	if(argc != 3){
+		printf("Usage: undo <undo-log>\n");
+		return 0;
+	}
+	
+	vector<UndoRecord> records;
+	if(!readUndoLog(argv[2], records)){
+		printf("[ERROR] %s is not an undo log\n", argv[2]);
+		return 0;
+	}
+	
+	// Latest records first, so a file recorded twice ends with its earliest header
+	int restored = 0;
+	for(int i = records.size() - 1; i >= 0; i--){
+		if(restoreFile(records.at(i))){
+			printf("Restored %s\n", records.at(i).path.c_str());
+			restored++;
+		}
+	}
+	printf("\nRestored %d of %lu files\n", restored, records.size());
+	
+	return 0;
+}
+
 int main(int argc, char* argv[]){
 	
-	// Parse arguments
-	if(argc != 4){
-		printf("Usage: <xml-filepath> <images-directory> <output-directory>\n", argv[0]);
+	// Subcommands
+	if(argc > 1 && strcmp(argv[1], "query") == 0)
+		return queryIndex(argc, argv);
+	if(argc > 1 && strcmp(argv[1], "extract") == 0)
+		return extractDirectory(argc, argv);
+	if(argc > 1 && strcmp(argv[1], "undo") == 0)
+		return undoRun(argc, argv);
+	
+	// Parse options
+	AssignOptions options;
+	int arg = 1;
+	while(arg < argc && strncmp(argv[arg], "--", 2) == 0){
+		string option = argv[arg++];
+		
+		if(option == "--little-endian")
+			options.endianess = 0;
+		else if(option == "--big-endian")
+			options.endianess = 1;
+		else if(option == "--trace" && arg < argc)
+			options.tracePath = argv[arg++];
+		else if(option == "--readahead" && arg < argc)
+			options.cache.readahead = atoi(argv[arg++]);
+		else if(option == "--dontneed")
+			options.cache.dontneed = true;
+		else if(option == "--direct")
+			options.cache.direct = true;
+		else if(option == "--index" && arg < argc)
+			options.indexPath = argv[arg++];
+		else if(option == "--hdd-jobs" && arg < argc)
+			options.hddJobs = atoi(argv[arg++]);
+		else if(option == "--ssd-jobs" && arg < argc)
+			options.ssdJobs = atoi(argv[arg++]);
+		else if(option == "--undo-log" && arg < argc)
+			options.undoLogPath = argv[arg++];
+		else if(option == "--verify")
+			options.verify = true;
+		else if(option == "--report" && arg < argc)
+			options.reportPath = argv[arg++];
+		else if(option == "--thumbnail")
+			options.thumbnail = true;
+		else{
+			printf("Unknown option: %s\n", option.c_str());
+			return 0;
+		}
+	}
+	
+	// Parse arguments; there can be multiple output directories
+	if(argc - arg < 3){
+		printf("Usage: [options] <xml-filepath> <images-directory> <output-directory> [<output-directory> ...]\n");
 		return 0;
 	}
-	string imgPath = argv[2];
-	string outPath = argv[3];
+	string xmlPath = argv[arg];
+	string imgPath = argv[arg + 1];
+	vector<string> outPaths(argv + arg + 2, argv + argc);
+	
+	// Handle sidecar flag; XMP sidecars are written next to the source JPG files
+	bool sidecar = false;
+	if(outPaths.at(0) == "-x"){
+		if(outPaths.size() > 1){
+			printf("-x cannot be used with other output directories\n");
+			return 0;
+		}
+		outPaths.at(0) = imgPath;
+		sidecar = true;
+	}
 	// Handle overwrite flag; set output directory the same as input directory
-	if(outPath == "-o"){
-		outPath = imgPath;
-		printf("[WARNING] Overwriting");
+	for(int i = 0; i < outPaths.size(); i++){
+		if(outPaths.at(i) == "-o"){
+			outPaths.at(i) = imgPath;
+			printf("[WARNING] Overwriting");
+		}
 	}
 	
 	// Verify that file or directory exists; quits program if cannot be opened
-	vector<XmlFrame> roll = parseXml(argv[1]);
+	vector<XmlFrame> roll = parseXml(xmlPath);
 	vector<string> filenames = getFilenames(imgPath.c_str());
-	getFilenames(outPath.c_str());
+	for(int i = 0; i < outPaths.size(); i++)
+		getFilenames(outPaths.at(i).c_str());
+	
+	// Output directories that are the same directory under another name (eg. "out" and "./out/")
+	// are written once; otherwise both would write the same temporary files at the same time
+	vector<string> uniqueOutPaths;
+	vector<pair<dev_t, ino_t>> outDirectories;
+	for(int i = 0; i < outPaths.size(); i++){
+		struct stat st;
+		if(stat(outPaths.at(i).c_str(), &st) != 0){
+			perror("Could not open output directory");
+			return 0;
+		}
+		
+		pair<dev_t, ino_t> directory = make_pair(st.st_dev, st.st_ino);
+		if(find(outDirectories.begin(), outDirectories.end(), directory) != outDirectories.end()){
+			printf("[WARNING] %s is already an output directory; it is written once\n", outPaths.at(i).c_str());
+			continue;
+		}
+		outDirectories.push_back(directory);
+		uniqueOutPaths.push_back(outPaths.at(i));
+	}
+	outPaths = uniqueOutPaths;
 	
+	// An output directory that is the images directory (-o, or the same directory under another
+	// name, eg. "./in", an absolute path or a symlink) overwrites the source files
+	struct stat imgStat;
+	if(!sidecar && stat(imgPath.c_str(), &imgStat) == 0){
+		for(int i = 0; i < outDirectories.size(); i++){
+			if(outDirectories.at(i) == make_pair(imgStat.st_dev, imgStat.st_ino))
+				options.overwriteOutput = i;
+		}
+	}
 	
 	// Check if number of XML entries match the number of files to be assigned metadata
 	if(roll.size() != filenames.size()){
@@ -213,25 +726,135 @@ int main(int argc, char* argv[]){
 		}
 	}
 	
+	// Undo log of the overwritten files; by default a new log for each run in the current
+	// directory (<roll>-<date>-<time>.undo)
+	UndoLog undoLog;
+	if(options.overwriteOutput >= 0){
+		if(options.undoLogPath.empty()){
+			char timestamp[32];
+			time_t now = time(NULL);
+			strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", localtime(&now));
+			options.undoLogPath = rollName(xmlPath) + "-" + timestamp + ".undo";
+			for(int n = 2; access(options.undoLogPath.c_str(), F_OK) == 0; n++)		// Runs within the same second
+				options.undoLogPath = rollName(xmlPath) + "-" + timestamp + "-" + to_string(n) + ".undo";
+		}
+		if(!undoLog.create(options.undoLogPath)){
+			perror("Could not create undo log");
+			return 0;
+		}
+		options.undoLog = &undoLog;
+		printf("\nUndo log: %s (restore with: undo %s)\n", options.undoLogPath.c_str(), options.undoLogPath.c_str());
+	}
+	
+	// Queue each frame on the device of its input file
+	// Prefetching happens within each device queue (not for sidecars, which do not read the JPG)
+	CachePolicy queuePolicy = options.cache;
+	if(sidecar)
+		queuePolicy.readahead = 0;
+	IOScheduler scheduler(queuePolicy, options.hddJobs, options.ssdJobs);
+	options.scheduler = &scheduler;
+	for(int i = 0; i < filenames.size() && i < roll.size(); i++){	// Frames without a recorded exposure are skipped
+		if(!isRecorded(roll.at(i))){
+			printf("[WARNING] No exposure recorded for %s; skipped\n", filenames.at(i).c_str());
+			continue;
+		}
+		scheduler.addJob(i, imgPath + "/" + filenames.at(i));
+	}
+	scheduler.printQueues();
+	
+	// Writer threads for the outputs after the first (which each worker writes itself), so
+	// every worker can write all of its outputs at the same time
+	WriterPool writers((outPaths.size() > 1) ? scheduler.getWorkerCount() * (outPaths.size() - 1) : 0);
+	options.writers = &writers;
+	
 	// Assign metadata to files
-	for(int i = 0; i < filenames.size(); i++){
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	atomic<size_t> bytesRead(0);
+	vector<IndexRow> indexRows;
+	vector<string> reportLines;
+	mutex outputLock;		// Status messages, report lines and index rows
+	scheduler.run([&](int i){
 		string filename = filenames.at(i);
 		string inFilepath = imgPath + "/" + filename;
-		string outFilepath = outPath + "/" + filename;
-		
-		if(i > roll.size())	// No more recorded exposures, quit
-			break;
+		vector<string> outFilepaths;
+		for(int o = 0; o < outPaths.size(); o++)
+			outFilepaths.push_back(outPaths.at(o) + "/" + filename);
+		if(sidecar)
+			outFilepaths.at(0) = sidecarFilepath(outFilepaths.at(0));
 		
 		// Status messages
-		printf("\nAssigning Exif metadata (%d of %lu)\n", (i+1), filenames.size());
-		printf("\tInput:\t\t%s\n", inFilepath.c_str());
-		printf("\tOutput:\t\t%s\n\n", outFilepath.c_str());
-		printf("\tAperture:\tf/%.1f\n", (roll.at(i).aperture / 10.0));
-		printf("\tShutter Speed:\t1/%ds\n\n", (roll.at(i).shutterSpeed / 10));
+		{
+			lock_guard<mutex> guard(outputLock);
+			printf("\nAssigning Exif metadata (%d of %lu)\n", (i+1), filenames.size());
+			printf("\tInput:\t\t%s\n", inFilepath.c_str());
+			for(int o = 0; o < outFilepaths.size(); o++)
+				printf("\tOutput:\t\t%s\n", outFilepaths.at(o).c_str());
+			printf("\n");
+			printf("\tAperture:\tf/%.1f\n", (roll.at(i).aperture / 10.0));
+			printf("\tShutter Speed:\t1/%ds\n\n", (roll.at(i).shutterSpeed / 10));
+		}
 		
 		// Write to output file
-		writeMetadata(inFilepath, outFilepath, roll.at(i));
+		TRACE_FRAME("frame", inFilepath);
+		WriteResult result;
+		if(sidecar){
+			result.written.push_back(writeSidecar(outFilepaths.at(0), roll.at(i)));
+			result.mismatched.push_back(false);
+			result.outputDigests.push_back(0);
+		}
+		else{
+			result = writeMetadata(inFilepath, outFilepaths, roll.at(i), options);
+		}
+		bytesRead += result.bytesRead;
+		
+		// Add each output to report
+		lock_guard<mutex> guard(outputLock);
+		for(int o = 0; o < outFilepaths.size() && !options.reportPath.empty(); o++){
+			const char* status = result.mismatched.at(o) ? "mismatch" : (result.written.at(o) ? "written" : "failed");
+			char digests[64] = "";
+			if(options.verify && !sidecar)
+				snprintf(digests, sizeof(digests), "%s,%016llx,%016llx", xxh3HashName, result.inputDigest, result.outputDigests.at(o));
+			else
+				snprintf(digests, sizeof(digests), ",,");
+			reportLines.push_back(inFilepath + "," + outFilepaths.at(o) + "," + status + "," + digests);
+		}
+		
+		// Add each written frame to index
+		for(int o = 0; o < outFilepaths.size() && !options.indexPath.empty(); o++){
+			if(!result.written.at(o))
+				continue;
+			
+			IndexRow row;
+			row.path = canonicalFilepath(sidecar ? inFilepath : outFilepaths.at(o));		// Sidecar frames are indexed by their JPG
+			row.roll = rollName(xmlPath);
+			row.aperture = roll.at(i).aperture;
+			row.shutterSpeed = roll.at(i).shutterSpeed;
+			indexRows.push_back(row);
+		}
+	});
+	
+	// Write report of every output, sorted by input file
+	if(!options.reportPath.empty()){
+		sort(reportLines.begin(), reportLines.end());
+		ofstream report(options.reportPath, ios::trunc);
+		report << "input,output,status,hash,inputDigest,outputDigest\n";
+		for(int i = 0; i < reportLines.size(); i++)
+			report << reportLines.at(i) << "\n";
+		if(!report.good())
+			perror("Could not write report file");
 	}
+	
+	// Update index with assigned frames
+	if(!options.indexPath.empty() && !updateIndex(options.indexPath, indexRows))
+		perror("Could not update index file");
+	
+	// Throughput of the run
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("\nRead %.1f MB in %.3fs (%.1f MB/s)\n", bytesRead.load() / 1e6, seconds, (bytesRead.load() / 1e6) / seconds);
+	
+	// Export trace of the run
+	if(!options.tracePath.empty() && !TRACE_EXPORT(options.tracePath))
+		printf("[WARNING] Trace not written (compile with -DFILM_EXIF_TRACE to enable tracing)\n");
 
 	return 0;
 }
\ No newline at end of file
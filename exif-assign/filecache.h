@@ -0,0 +1,226 @@
+#include<string>
+#include<vector>
+#include<functional>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<cerrno>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+
+using namespace std;
+
+const size_t directAlignment = 4096;	// Buffer, offset and length alignment required by O_DIRECT
+
+// Page cache policy for reading and writing image files
+struct CachePolicy{
+	int readahead = 0;		// Number of upcoming input files to prefetch
+	bool dontneed = false;	// Drop finished input and output files from the page cache
+	bool direct = false;	// Read input files with O_DIRECT (bypasses the page cache)
+};
+
+// Byte buffer holding an entire file
+// Memory is aligned so the file can be read with O_DIRECT
+class FileBuffer{
+	private:
+		unsigned char* bytes;
+		size_t size;
+	
+	public:
+		FileBuffer(){
+			bytes = NULL;
+			size = 0;
+		}
+		
+		// The buffer owns its memory, so it can be moved but not copied
+		FileBuffer(const FileBuffer&) = delete;
+		FileBuffer& operator=(const FileBuffer&) = delete;
+		
+		FileBuffer(FileBuffer&& other){
+			bytes = other.bytes;
+			size = other.size;
+			other.bytes = NULL;
+			other.size = 0;
+		}
+		
+		FileBuffer& operator=(FileBuffer&& other){
+			if(this != &other){
+				free(bytes);
+				bytes = other.bytes;
+				size = other.size;
+				other.bytes = NULL;
+				other.size = 0;
+			}
+			return *this;
+		}
+		
+		~FileBuffer(){
+			free(bytes);
+		}
+		
+		// Allocates the buffer; capacity is rounded up to the O_DIRECT alignment
+		// Returns false (with an empty buffer) if the memory could not be allocated
+		bool allocate(size_t newSize){
+			free(bytes);
+			bytes = NULL;
+			size = 0;
+			
+			size_t capacity = ((newSize / directAlignment) + 1) * directAlignment;
+			if(posix_memalign((void**)&bytes, directAlignment, capacity) != 0){
+				bytes = NULL;
+				return false;
+			}
+			size = newSize;
+			return true;
+		}
+		
+		// Returns the buffer capacity in bytes
+		size_t getCapacity(){
+			return ((size / directAlignment) + 1) * directAlignment;
+		}
+		
+		unsigned char* getBytes(){
+			return bytes;
+		}
+		
+		size_t getSize(){
+			return size;
+		}
+};
+
+// Reads an entire file into buffer; returns false if the file could not be read
+// With O_DIRECT, reads bypass the page cache; if the filesystem does not support it, the
+// file is read normally
+bool readFile(string filepath, FileBuffer& buffer, CachePolicy policy){
+	int fd = -1;
+	if(policy.direct)
+		fd = open(filepath.c_str(), O_RDONLY | O_DIRECT);
+	if(fd < 0)
+		fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !buffer.allocate(st.st_size)){
+		close(fd);
+		return false;
+	}
+	
+	// Read whole (aligned) blocks until end of file; the last read returns a partial block
+	size_t total = 0;
+	while(total < buffer.getSize()){
+		ssize_t n = read(fd, buffer.getBytes() + total, buffer.getCapacity() - total);
+		
+		// O_DIRECT can be refused at read time (eg. tmpfs); fall back to a normal read
+		if(n < 0 && errno == EINVAL && policy.direct){
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			policy.direct = false;
+			continue;
+		}
+		if(n <= 0)
+			break;
+		total += n;
+	}
+	
+	if(policy.dontneed)
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+	
+	return total == buffer.getSize();
+}
+
+// Hints the kernel to start reading a file into the page cache (asynchronously)
+void prefetchFile(string filepath){
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0)
+		return;
+	
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
+
+// Drops a written file from the page cache
+// Dirty pages cannot be dropped, so the file is flushed to disk first
+void dropFileCache(string filepath){
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0)
+		return;
+	
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+// Byte range of a buffer to be written to a file
+struct ByteRange{
+	const unsigned char* bytes;
+	size_t size;
+};
+
+// Syncs a directory, so the entries renamed into it survive a crash
+bool syncDirectory(string directory){
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if(fd < 0)
+		return false;
+	
+	bool synced = (fsync(fd) == 0);
+	int error = errno;
+	close(fd);
+	errno = error;
+	return synced;
+}
+
+// Writes byte ranges (in order) to a new file
+// Two-phase commit; the ranges are written to a temporary file which then replaces filepath,
+// so an existing file (eg. when overwriting) is never left partially written
+// The temporary file is synced before the rename and the directory after it, so after a crash
+// either the original or the new file is on disk; if the directory cannot be synced, a warning
+// is printed but the file is still written
+// If check is given, it is called with the temporary filepath once the file is written; if it
+// returns false, filepath is not replaced and errno is set to EBADMSG
+// Returns false and sets errno if the file could not be written
+bool writeFile(string filepath, vector<ByteRange> ranges, function<bool(string)> check = NULL){
+	string tempFilepath = filepath + ".tmp";
+	int fd = open(tempFilepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		return false;
+	
+	for(int i = 0; i < ranges.size(); i++){
+		size_t total = 0;
+		while(total < ranges.at(i).size){
+			ssize_t n = write(fd, ranges.at(i).bytes + total, ranges.at(i).size - total);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0){
+				int error = errno;
+				close(fd);
+				remove(tempFilepath.c_str());
+				errno = error;
+				return false;
+			}
+			total += n;
+		}
+	}
+	
+	bool synced = (fdatasync(fd) == 0);
+	bool closed = (close(fd) == 0) && synced;
+	if(closed && check && !check(tempFilepath)){
+		remove(tempFilepath.c_str());
+		errno = EBADMSG;
+		return false;
+	}
+	if(!closed || rename(tempFilepath.c_str(), filepath.c_str()) != 0){
+		int error = errno;
+		remove(tempFilepath.c_str());
+		errno = error;
+		return false;
+	}
+	
+	// filepath has been replaced, so a directory that cannot be synced is only a warning
+	size_t slash = filepath.find_last_of('/');
+	if(!syncDirectory((slash == string::npos) ? "." : filepath.substr(0, slash + 1)))
+		printf("[WARNING] Could not sync the directory of %s (%s); the new file may not survive a crash\n", filepath.c_str(), strerror(errno));
+	
+	return true;
+}
@@ -0,0 +1,240 @@
+#include<cstddef>
+#include<cstring>
+
+#ifdef __SSE2__
+#include<emmintrin.h>
+#endif
+
+// XXH3 (64-bit, seed 0)
+// Fast hash of large buffers (eg. the image data of a JPG). Digests are the same as
+// XXH3_64bits() of the xxHash library (and xxhsum -H3), so they can be checked with other
+// tools; eg. the empty input hashes to 2d06800538d394c2 and "abc" to 78af5f94892f3950.
+// Inputs longer than 240 bytes are read in 64-byte stripes into 8 64-bit accumulators, with
+// the accumulators scrambled after every block of 16 stripes; shorter inputs are mixed directly.
+// The SSE2 and scalar versions give identical results.
+const char xxh3HashName[] = "xxh3-64";
+const size_t xxh3StripeSize = 64;
+const size_t xxh3SecretSize = 192;
+const size_t xxh3StripesPerBlock = (xxh3SecretSize - xxh3StripeSize) / 8;		// 1 KB blocks
+const unsigned long long xxhPrime32_1 = 0x9E3779B1ULL;
+const unsigned long long xxhPrime32_2 = 0x85EBCA77ULL;
+const unsigned long long xxhPrime32_3 = 0xC2B2AE3DULL;
+const unsigned long long xxhPrime64_1 = 0x9E3779B185EBCA87ULL;
+const unsigned long long xxhPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const unsigned long long xxhPrime64_3 = 0x165667B19E3779F9ULL;
+const unsigned long long xxhPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+const unsigned long long xxhPrime64_5 = 0x27D4EB2F165667C5ULL;
+
+// Default secret of XXH3
+const unsigned char xxh3Secret[xxh3SecretSize] = {
+	0xB8, 0xFE, 0x6C, 0x39, 0x23, 0xA4, 0x4B, 0xBE, 0x7C, 0x01, 0x81, 0x2C, 0xF7, 0x21, 0xAD, 0x1C,
+	0xDE, 0xD4, 0x6D, 0xE9, 0x83, 0x90, 0x97, 0xDB, 0x72, 0x40, 0xA4, 0xA4, 0xB7, 0xB3, 0x67, 0x1F,
+	0xCB, 0x79, 0xE6, 0x4E, 0xCC, 0xC0, 0xE5, 0x78, 0x82, 0x5A, 0xD0, 0x7D, 0xCC, 0xFF, 0x72, 0x21,
+	0xB8, 0x08, 0x46, 0x74, 0xF7, 0x43, 0x24, 0x8E, 0xE0, 0x35, 0x90, 0xE6, 0x81, 0x3A, 0x26, 0x4C,
+	0x3C, 0x28, 0x52, 0xBB, 0x91, 0xC3, 0x00, 0xCB, 0x88, 0xD0, 0x65, 0x8B, 0x1B, 0x53, 0x2E, 0xA3,
+	0x71, 0x64, 0x48, 0x97, 0xA2, 0x0D, 0xF9, 0x4E, 0x38, 0x19, 0xEF, 0x46, 0xA9, 0xDE, 0xAC, 0xD8,
+	0xA8, 0xFA, 0x76, 0x3F, 0xE3, 0x9C, 0x34, 0x3F, 0xF9, 0xDC, 0xBB, 0xC7, 0xC7, 0x0B, 0x4F, 0x1D,
+	0x8A, 0x51, 0xE0, 0x4B, 0xCD, 0xB4, 0x59, 0x31, 0xC8, 0x9F, 0x7E, 0xC9, 0xD9, 0x78, 0x73, 0x64,
+	0xEA, 0xC5, 0xAC, 0x83, 0x34, 0xD3, 0xEB, 0xC3, 0xC5, 0x81, 0xA0, 0xFF, 0xFA, 0x13, 0x63, 0xEB,
+	0x17, 0x0D, 0xDD, 0x51, 0xB7, 0xF0, 0xDA, 0x49, 0xD3, 0x16, 0x55, 0x26, 0x29, 0xD4, 0x68, 0x9E,
+	0x2B, 0x16, 0xBE, 0x58, 0x7D, 0x47, 0xA1, 0xFC, 0x8F, 0xF8, 0xB8, 0xD1, 0x7A, 0xD0, 0x31, 0xCE,
+	0x45, 0xCB, 0x3A, 0x8F, 0x95, 0x16, 0x04, 0x28, 0xAF, 0xD7, 0xFB, 0xCA, 0xBB, 0x4B, 0x40, 0x7E
+};
+
+// Reads 4 or 8 bytes as a little-endian value
+unsigned int readLittleEndian32(const unsigned char bytes[]){
+	unsigned int value;
+	memcpy(&value, bytes, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+	return value;
+}
+
+unsigned long long readLittleEndian64(const unsigned char bytes[]){
+	unsigned long long value;
+	memcpy(&value, bytes, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+}
+
+// Adds stripes to the accumulators; stripe s is keyed with the secret at s * 8
+// For each accumulator i: acc[i ^ 1] += data, acc[i] += low32(data ^ key) * high32(data ^ key)
+void xxh3AccumulateScalar(unsigned long long acc[8], const unsigned char bytes[], const unsigned char secret[], size_t stripes){
+	for(size_t s = 0; s < stripes; s++){
+		const unsigned char* stripe = bytes + s * xxh3StripeSize;
+		for(int i = 0; i < 8; i++){
+			unsigned long long data = readLittleEndian64(stripe + i * 8);
+			unsigned long long keyed = data ^ readLittleEndian64(secret + s * 8 + i * 8);
+			acc[i ^ 1] += data;
+			acc[i] += (keyed & 0xFFFFFFFFULL) * (keyed >> 32);
+		}
+	}
+}
+
+// Mixes the bits of each accumulator: acc = (acc ^ (acc >> 47) ^ key) * prime32_1
+void xxh3ScrambleScalar(unsigned long long acc[8], const unsigned char secret[]){
+	for(int i = 0; i < 8; i++)
+		acc[i] = (acc[i] ^ (acc[i] >> 47) ^ readLittleEndian64(secret + i * 8)) * xxhPrime32_1;
+}
+
+#if defined(__SSE2__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// SSE2 version; each 128-bit register holds two accumulators
+void xxh3AccumulateSSE2(unsigned long long acc[8], const unsigned char bytes[], const unsigned char secret[], size_t stripes){
+	__m128i lanes[4];
+	for(int i = 0; i < 4; i++)
+		lanes[i] = _mm_loadu_si128((const __m128i*)(acc + i * 2));
+	
+	for(size_t s = 0; s < stripes; s++){
+		const unsigned char* stripe = bytes + s * xxh3StripeSize;
+		for(int i = 0; i < 4; i++){
+			__m128i data = _mm_loadu_si128((const __m128i*)(stripe + i * 16));
+			__m128i key = _mm_loadu_si128((const __m128i*)(secret + s * 8 + i * 16));
+			__m128i keyed = _mm_xor_si128(data, key);
+			__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(3, 3, 1, 1)));
+			__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));		// Accumulator i ^ 1
+			lanes[i] = _mm_add_epi64(lanes[i], _mm_add_epi64(product, swapped));
+		}
+	}
+	
+	for(int i = 0; i < 4; i++)
+		_mm_storeu_si128((__m128i*)(acc + i * 2), lanes[i]);
+}
+
+void xxh3ScrambleSSE2(unsigned long long acc[8], const unsigned char secret[]){
+	const __m128i prime = _mm_set1_epi32((int)xxhPrime32_1);
+	for(int i = 0; i < 4; i++){
+		__m128i lane = _mm_loadu_si128((const __m128i*)(acc + i * 2));
+		__m128i key = _mm_loadu_si128((const __m128i*)(secret + i * 16));
+		lane = _mm_xor_si128(_mm_xor_si128(lane, _mm_srli_epi64(lane, 47)), key);
+		
+		// 64 x 32-bit multiply from two 32 x 32-bit multiplies
+		__m128i low = _mm_mul_epu32(lane, prime);
+		__m128i high = _mm_mul_epu32(_mm_srli_epi64(lane, 32), prime);
+		lane = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+		_mm_storeu_si128((__m128i*)(acc + i * 2), lane);
+	}
+}
+
+#define xxh3Accumulate xxh3AccumulateSSE2
+#define xxh3Scramble xxh3ScrambleSSE2
+#else
+#define xxh3Accumulate xxh3AccumulateScalar
+#define xxh3Scramble xxh3ScrambleScalar
+#endif
+
+// Folds the 128-bit product of two values into 64 bits
+unsigned long long xxh3MultiplyFold(unsigned long long a, unsigned long long b){
+	unsigned __int128 product = (unsigned __int128)a * b;
+	return (unsigned long long)product ^ (unsigned long long)(product >> 64);
+}
+
+// Final mixes of a 64-bit value (XXH64's avalanche, XXH3's avalanche, and rrmxmx)
+unsigned long long xxh64Avalanche(unsigned long long hash){
+	hash ^= hash >> 33;
+	hash *= xxhPrime64_2;
+	hash ^= hash >> 29;
+	hash *= xxhPrime64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+unsigned long long xxh3Avalanche(unsigned long long hash){
+	hash ^= hash >> 37;
+	hash *= 0x165667919E3779F9ULL;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+unsigned long long xxh3RRMXMX(unsigned long long hash, size_t length){
+	hash ^= ((hash << 49) | (hash >> 15)) ^ ((hash << 24) | (hash >> 40));
+	hash *= 0x9FB21C651E98DF25ULL;
+	hash ^= (hash >> 35) + length;
+	hash *= 0x9FB21C651E98DF25ULL;
+	hash ^= hash >> 28;
+	return hash;
+}
+
+// Mixes 16 bytes of input with 16 bytes of secret
+unsigned long long xxh3Mix16(const unsigned char bytes[], const unsigned char secret[]){
+	return xxh3MultiplyFold(readLittleEndian64(bytes) ^ readLittleEndian64(secret),
+		readLittleEndian64(bytes + 8) ^ readLittleEndian64(secret + 8));
+}
+
+// Returns the XXH3 hash of up to 16 bytes
+unsigned long long xxh3HashShort(const unsigned char bytes[], size_t length){
+	const unsigned char* secret = xxh3Secret;
+	if(length > 8){
+		unsigned long long low = readLittleEndian64(bytes) ^ readLittleEndian64(secret + 24) ^ readLittleEndian64(secret + 32);
+		unsigned long long high = readLittleEndian64(bytes + length - 8) ^ readLittleEndian64(secret + 40) ^ readLittleEndian64(secret + 48);
+		return xxh3Avalanche(length + __builtin_bswap64(low) + high + xxh3MultiplyFold(low, high));
+	}
+	if(length >= 4){
+		unsigned long long input = readLittleEndian32(bytes + length - 4) + ((unsigned long long)readLittleEndian32(bytes) << 32);
+		return xxh3RRMXMX(input ^ readLittleEndian64(secret + 8) ^ readLittleEndian64(secret + 16), length);
+	}
+	if(length > 0){
+		unsigned int combined = ((unsigned int)bytes[0] << 16) | ((unsigned int)bytes[length >> 1] << 24) |
+			bytes[length - 1] | ((unsigned int)length << 8);
+		return xxh64Avalanche(combined ^ (unsigned long long)(readLittleEndian32(secret) ^ readLittleEndian32(secret + 4)));
+	}
+	return xxh64Avalanche(readLittleEndian64(secret + 56) ^ readLittleEndian64(secret + 64));
+}
+
+// Returns the XXH3 hash of 17 to 240 bytes
+unsigned long long xxh3HashMedium(const unsigned char bytes[], size_t length){
+	const unsigned char* secret = xxh3Secret;
+	unsigned long long hash = length * xxhPrime64_1;
+	
+	// 17 to 128 bytes; 16-byte pairs from both ends, working inwards
+	if(length <= 128){
+		for(int i = (length - 1) / 32; i >= 0; i--){
+			hash += xxh3Mix16(bytes + i * 16, secret + i * 32);
+			hash += xxh3Mix16(bytes + length - (i + 1) * 16, secret + i * 32 + 16);
+		}
+		return xxh3Avalanche(hash);
+	}
+	
+	// 129 to 240 bytes; the first 8 rounds, then the rest with the secret offset by 3
+	size_t rounds = length / 16;
+	for(size_t i = 0; i < 8; i++)
+		hash += xxh3Mix16(bytes + i * 16, secret + i * 16);
+	hash = xxh3Avalanche(hash);
+	for(size_t i = 8; i < rounds; i++)
+		hash += xxh3Mix16(bytes + i * 16, secret + (i - 8) * 16 + 3);
+	hash += xxh3Mix16(bytes + length - 16, secret + 136 - 17);
+	return xxh3Avalanche(hash);
+}
+
+// Returns the XXH3 hash of a buffer
+unsigned long long xxh3Hash64(const unsigned char bytes[], size_t length){
+	if(length <= 16)
+		return xxh3HashShort(bytes, length);
+	if(length <= 240)
+		return xxh3HashMedium(bytes, length);
+	
+	unsigned long long acc[8] = {
+		xxhPrime32_3, xxhPrime64_1, xxhPrime64_2, xxhPrime64_3, xxhPrime64_4, xxhPrime32_2, xxhPrime64_5, xxhPrime32_1
+	};
+	
+	// Whole blocks (each followed by a scramble), then the remaining whole stripes; a stripe
+	// ending at the last byte is left for the last stripe
+	size_t blockSize = xxh3StripesPerBlock * xxh3StripeSize;
+	size_t blocks = (length - 1) / blockSize;
+	for(size_t b = 0; b < blocks; b++){
+		xxh3Accumulate(acc, bytes + b * blockSize, xxh3Secret, xxh3StripesPerBlock);
+		xxh3Scramble(acc, xxh3Secret + xxh3SecretSize - xxh3StripeSize);
+	}
+	xxh3Accumulate(acc, bytes + blocks * blockSize, xxh3Secret, ((length - 1) - blocks * blockSize) / xxh3StripeSize);
+	
+	// Last stripe (the last 64 bytes, which may overlap the previous stripe)
+	xxh3Accumulate(acc, bytes + length - xxh3StripeSize, xxh3Secret + xxh3SecretSize - xxh3StripeSize - 7, 1);
+	
+	// Merge accumulators, then avalanche
+	unsigned long long hash = length * xxhPrime64_1;
+	for(int i = 0; i < 8; i += 2)
+		hash += xxh3MultiplyFold(acc[i] ^ readLittleEndian64(xxh3Secret + 11 + i * 8), acc[i + 1] ^ readLittleEndian64(xxh3Secret + 11 + i * 8 + 8));
+	return xxh3Avalanche(hash);
+}
@@ -0,0 +1,414 @@
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<climits>
+#include<cstring>
+#include<cstdio>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/file.h>
+
+using namespace std;
+
+// Index of assigned frames, stored as columns so exposure queries never open the images
+//
+// File layout (all values in host byte order, so the file can be memory mapped directly):
+// IndexHeader
+// IndexColumn (per column)
+// Column data (per column, 8-byte aligned):
+//		uint32 column - uint32 value per row, followed by a BlockSummary per block of rows
+//		string column - uint64 offset per row (+ 1 for the end of the last string), followed by the characters
+//
+// Rows are sorted by aperture, then shutter speed, then path
+
+const char indexMagic[8] = {'F', 'X', 'I', 'N', 'D', 'E', 'X', '1'};
+const unsigned int indexByteOrder = 0x01020304;	// Detects an index written on a host with different byte order
+const unsigned int indexBlockSize = 1024;		// Rows per block summary
+
+// Column types
+const unsigned int uintColumn = 0;
+const unsigned int stringColumn = 1;
+
+// Column names
+const char pathColumn[] = "path";
+const char rollColumn[] = "roll";
+const char apertureColumn[] = "aperture";
+const char shutterSpeedColumn[] = "shutterSpeed";
+
+struct IndexHeader{
+	char magic[8];
+	unsigned int byteOrder;
+	unsigned int numRows;
+	unsigned int blockSize;
+	unsigned int numColumns;
+};
+
+struct IndexColumn{
+	char name[16];
+	unsigned int type;
+	unsigned int reserved;
+	unsigned long long offset;	// From start of file
+};
+
+struct BlockSummary{
+	unsigned int min;
+	unsigned int max;
+};
+
+// One assigned frame
+// Aperture and shutter speed are the XML values (see documentation)
+struct IndexRow{
+	string path;
+	string roll;
+	unsigned int aperture;
+	unsigned int shutterSpeed;
+};
+
+// Frame filter; ranges are inclusive and in XML values
+struct IndexQuery{
+	unsigned int apertureMin = 0;
+	unsigned int apertureMax = UINT_MAX;
+	unsigned int shutterSpeedMin = 0;
+	unsigned int shutterSpeedMax = UINT_MAX;
+	string roll;		// Empty matches every roll
+};
+
+// Returns offset rounded up to a multiple of 8
+unsigned long long alignIndexOffset(unsigned long long offset){
+	return (offset + 7) & ~7ULL;
+}
+
+// Returns the number of block summaries for numRows rows
+unsigned int numIndexBlocks(unsigned int numRows){
+	return (numRows + indexBlockSize - 1) / indexBlockSize;
+}
+
+// Read-only, memory mapped index file
+class IndexFile{
+	private:
+		unsigned char* map;
+		size_t mapSize;
+		IndexHeader* header;
+		IndexColumn* columns;
+		
+		// Returns column by name, or NULL if the index has no such column
+		IndexColumn* findColumn(const char name[], unsigned int type){
+			for(unsigned int i = 0; i < header->numColumns; i++){
+				if(strncmp(columns[i].name, name, sizeof(columns[i].name)) == 0 && columns[i].type == type)
+					return &columns[i];
+			}
+			return NULL;
+		}
+		
+		// Returns true if size bytes at offset are inside the mapped file
+		bool inFile(unsigned long long offset, unsigned long long size){
+			return offset <= mapSize && size <= mapSize - offset;
+		}
+		
+		// Returns true if a column's data (and block summaries) are inside the mapped file
+		// A string column's offsets must also end inside the file; each row's offsets are
+		// checked against that end when the string is read
+		bool validColumn(IndexColumn& column){
+			unsigned long long numRows = header->numRows;
+			if(column.offset % 8 != 0)
+				return false;
+			
+			if(column.type == uintColumn){
+				unsigned long long summaries = alignIndexOffset(column.offset + numRows * 4);
+				return	inFile(column.offset, numRows * 4) &&
+						inFile(summaries, numIndexBlocks(header->numRows) * sizeof(BlockSummary));
+			}
+			if(column.type == stringColumn){
+				if(!inFile(column.offset, (numRows + 1) * 8))
+					return false;
+				const unsigned long long* offsets = (const unsigned long long*)(map + column.offset);
+				return inFile(column.offset + (numRows + 1) * 8, offsets[numRows]);
+			}
+			return false;
+		}
+		
+		// Returns true if a row's string is inside its column (see validColumn)
+		bool validString(const unsigned long long* offsets, unsigned int row){
+			return offsets[row] <= offsets[row + 1] && offsets[row + 1] <= offsets[header->numRows];
+		}
+	
+	public:
+		IndexFile(){
+			map = NULL;
+			mapSize = 0;
+			header = NULL;
+			columns = NULL;
+		}
+		
+		~IndexFile(){
+			if(map != NULL)
+				munmap(map, mapSize);
+		}
+		
+		// Maps index file into memory; returns false if it does not exist or is not an index
+		// Every column must lie inside the file, so a truncated or corrupt index is rejected
+		// here rather than read out of bounds by a query
+		bool open(string filepath){
+			int fd = ::open(filepath.c_str(), O_RDONLY);
+			if(fd < 0)
+				return false;
+			
+			struct stat st;
+			if(fstat(fd, &st) != 0 || st.st_size < sizeof(IndexHeader)){
+				close(fd);
+				errno = EINVAL;
+				return false;
+			}
+			
+			mapSize = st.st_size;
+			void* mapped = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if(mapped == MAP_FAILED)
+				return false;
+			map = (unsigned char*)mapped;
+			
+			header = (IndexHeader*)map;
+			columns = (IndexColumn*)(map + sizeof(IndexHeader));
+			bool valid =	memcmp(header->magic, indexMagic, 8) == 0 &&
+							header->byteOrder == indexByteOrder &&
+							header->blockSize == indexBlockSize &&
+							inFile(sizeof(IndexHeader), header->numColumns * (unsigned long long)sizeof(IndexColumn));
+			for(unsigned int i = 0; i < header->numColumns && valid; i++)
+				valid = validColumn(columns[i]);
+			valid = valid &&	findColumn(pathColumn, stringColumn) != NULL && findColumn(rollColumn, stringColumn) != NULL &&
+								findColumn(apertureColumn, uintColumn) != NULL && findColumn(shutterSpeedColumn, uintColumn) != NULL;
+			if(!valid){
+				fprintf(stderr, "[ERROR] %s is not a film-exif index (or is corrupt)\n", filepath.c_str());
+				errno = EINVAL;
+				return false;
+			}
+			
+			return true;
+		}
+		
+		unsigned int getNumRows(){
+			return header->numRows;
+		}
+		
+		// Returns the values of a uint32 column, and its block summaries
+		const unsigned int* getUIntColumn(const char name[], const BlockSummary** summaries){
+			IndexColumn* column = findColumn(name, uintColumn);
+			if(column == NULL)
+				return NULL;
+			
+			const unsigned int* values = (const unsigned int*)(map + column->offset);
+			*summaries = (const BlockSummary*)(map + alignIndexOffset(column->offset + header->numRows * 4ULL));
+			return values;
+		}
+		
+		// Returns the characters of a string column, and the offset of each row's string
+		const char* getStringColumn(const char name[], const unsigned long long** offsets){
+			IndexColumn* column = findColumn(name, stringColumn);
+			if(column == NULL)
+				return NULL;
+			
+			*offsets = (const unsigned long long*)(map + column->offset);
+			return (const char*)(*offsets + header->numRows + 1);
+		}
+		
+		// Returns the string of a string column at row
+		string getString(const char name[], unsigned int row){
+			const unsigned long long* offsets;
+			const char* chars = getStringColumn(name, &offsets);
+			if(chars == NULL || !validString(offsets, row))
+				return "";
+			
+			return string(chars + offsets[row], offsets[row + 1] - offsets[row]);
+		}
+		
+		// Reads every row of the index; returns false if a column is missing
+		bool getRows(vector<IndexRow>& rows){
+			const BlockSummary* summaries;
+			const unsigned int* apertures = getUIntColumn(apertureColumn, &summaries);
+			const unsigned int* shutterSpeeds = getUIntColumn(shutterSpeedColumn, &summaries);
+			if(apertures == NULL || shutterSpeeds == NULL)
+				return false;
+			
+			rows.resize(header->numRows);
+			for(unsigned int i = 0; i < header->numRows; i++){
+				rows.at(i).path = getString(pathColumn, i);
+				rows.at(i).roll = getString(rollColumn, i);
+				rows.at(i).aperture = apertures[i];
+				rows.at(i).shutterSpeed = shutterSpeeds[i];
+			}
+			
+			return true;
+		}
+		
+		// Returns the rows matching query
+		// Blocks whose summaries fall outside the aperture or shutter speed range are skipped
+		vector<unsigned int> query(IndexQuery filter){
+			vector<unsigned int> matches;
+			const BlockSummary* apertureBlocks = NULL;
+			const BlockSummary* shutterSpeedBlocks = NULL;
+			const unsigned int* apertures = getUIntColumn(apertureColumn, &apertureBlocks);
+			const unsigned int* shutterSpeeds = getUIntColumn(shutterSpeedColumn, &shutterSpeedBlocks);
+			const unsigned long long* rollOffsets = NULL;
+			const char* rolls = getStringColumn(rollColumn, &rollOffsets);
+			if(apertures == NULL || shutterSpeeds == NULL || rolls == NULL)
+				return matches;
+			
+			for(unsigned int block = 0; block < numIndexBlocks(header->numRows); block++){
+				if(	apertureBlocks[block].max < filter.apertureMin ||
+					apertureBlocks[block].min > filter.apertureMax ||
+					shutterSpeedBlocks[block].max < filter.shutterSpeedMin ||
+					shutterSpeedBlocks[block].min > filter.shutterSpeedMax)
+					continue;
+				
+				unsigned int last = min((block + 1) * indexBlockSize, header->numRows);
+				for(unsigned int i = block * indexBlockSize; i < last; i++){
+					if(	apertures[i] >= filter.apertureMin && apertures[i] <= filter.apertureMax &&
+						shutterSpeeds[i] >= filter.shutterSpeedMin && shutterSpeeds[i] <= filter.shutterSpeedMax &&
+						(filter.roll.empty() || (
+							validString(rollOffsets, i) && rollOffsets[i + 1] - rollOffsets[i] == filter.roll.length() &&
+							memcmp(rolls + rollOffsets[i], filter.roll.data(), filter.roll.length()) == 0)))
+						matches.push_back(i);
+				}
+			}
+			
+			return matches;
+		}
+};
+
+// Appends a uint32 column (values, then block summaries) to the index bytes
+void writeUIntColumn(vector<unsigned char>& file, IndexColumn& column, vector<unsigned int> values){
+	column.type = uintColumn;
+	column.offset = file.size();
+	file.insert(end(file), (unsigned char*)values.data(), (unsigned char*)(values.data() + values.size()));
+	file.resize(alignIndexOffset(file.size()));
+	
+	for(unsigned int block = 0; block < numIndexBlocks(values.size()); block++){
+		unsigned int last = min((block + 1) * indexBlockSize, (unsigned int)values.size());
+		BlockSummary summary = {UINT_MAX, 0};
+		for(unsigned int i = block * indexBlockSize; i < last; i++){
+			summary.min = min(summary.min, values.at(i));
+			summary.max = max(summary.max, values.at(i));
+		}
+		file.insert(end(file), (unsigned char*)&summary, (unsigned char*)(&summary + 1));
+	}
+}
+
+// Appends a string column (offsets, then characters) to the index bytes
+void writeStringColumn(vector<unsigned char>& file, IndexColumn& column, vector<string> values){
+	column.type = stringColumn;
+	column.offset = file.size();
+	
+	vector<unsigned long long> offsets;
+	string chars;
+	for(int i = 0; i < values.size(); i++){
+		offsets.push_back(chars.size());
+		chars.append(values.at(i));
+	}
+	offsets.push_back(chars.size());
+	
+	file.insert(end(file), (unsigned char*)offsets.data(), (unsigned char*)(offsets.data() + offsets.size()));
+	file.insert(end(file), chars.begin(), chars.end());
+	file.resize(alignIndexOffset(file.size()));
+}
+
+// Writes rows to a new index file
+// The index is written to a temporary file, synced and renamed, so readers never see a partial
+// index and a crash leaves either the old or the new index
+bool writeIndex(string filepath, vector<IndexRow> rows){
+	sort(rows.begin(), rows.end(), [](const IndexRow& a, const IndexRow& b){
+		if(a.aperture != b.aperture)
+			return a.aperture < b.aperture;
+		if(a.shutterSpeed != b.shutterSpeed)
+			return a.shutterSpeed < b.shutterSpeed;
+		return a.path < b.path;
+	});
+	
+	vector<string> paths, rolls;
+	vector<unsigned int> apertures, shutterSpeeds;
+	for(int i = 0; i < rows.size(); i++){
+		paths.push_back(rows.at(i).path);
+		rolls.push_back(rows.at(i).roll);
+		apertures.push_back(rows.at(i).aperture);
+		shutterSpeeds.push_back(rows.at(i).shutterSpeed);
+	}
+	
+	// Header and column directory are filled in once the column offsets are known
+	IndexHeader header;
+	memcpy(header.magic, indexMagic, 8);
+	header.byteOrder = indexByteOrder;
+	header.numRows = rows.size();
+	header.blockSize = indexBlockSize;
+	header.numColumns = 4;
+	
+	IndexColumn columns[4];
+	memset(columns, 0, sizeof(columns));
+	strcpy(columns[0].name, pathColumn);
+	strcpy(columns[1].name, rollColumn);
+	strcpy(columns[2].name, apertureColumn);
+	strcpy(columns[3].name, shutterSpeedColumn);
+	
+	vector<unsigned char> file(sizeof(header) + sizeof(columns));
+	writeStringColumn(file, columns[0], paths);
+	writeStringColumn(file, columns[1], rolls);
+	writeUIntColumn(file, columns[2], apertures);
+	writeUIntColumn(file, columns[3], shutterSpeeds);
+	
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), columns, sizeof(columns));
+	
+	string tempFilepath = filepath + ".tmp";
+	FILE* index = fopen(tempFilepath.c_str(), "wb");
+	if(index == NULL)
+		return false;
+	bool written = fwrite(file.data(), 1, file.size(), index) == file.size() && fflush(index) == 0 &&
+		fdatasync(fileno(index)) == 0;
+	written = (fclose(index) == 0) && written;
+	
+	return written && rename(tempFilepath.c_str(), filepath.c_str()) == 0;
+}
+
+// Adds rows to an index file, creating it if it does not exist (see updateIndex)
+bool mergeIndex(string filepath, vector<IndexRow> newRows){
+	vector<IndexRow> rows;
+	if(access(filepath.c_str(), F_OK) == 0){
+		IndexFile index;
+		if(!index.open(filepath) || !index.getRows(rows))
+			return false;		// Never overwrite a file that is not an index
+	}
+	
+	sort(newRows.begin(), newRows.end(), [](const IndexRow& a, const IndexRow& b){
+		return a.path < b.path;
+	});
+	rows.erase(remove_if(rows.begin(), rows.end(), [&](const IndexRow& row){
+		return binary_search(newRows.begin(), newRows.end(), row, [](const IndexRow& a, const IndexRow& b){
+			return a.path < b.path;
+		});
+	}), rows.end());
+	rows.insert(rows.end(), newRows.begin(), newRows.end());
+	
+	return writeIndex(filepath, rows);
+}
+
+// Adds rows to an index file, creating it if it does not exist
+// Existing rows with the same path are replaced (eg. a roll that is assigned again)
+// The update holds an exclusive lock on <index>.lock, so concurrent runs update the index one
+// after the other instead of losing each other's rows (the index itself is replaced by the
+// rename, so it cannot hold the lock)
+bool updateIndex(string filepath, vector<IndexRow> newRows){
+	string lockFilepath = filepath + ".lock";
+	int lock = open(lockFilepath.c_str(), O_RDWR | O_CREAT, 0644);
+	if(lock < 0)
+		return false;
+	while(flock(lock, LOCK_EX) != 0){
+		if(errno != EINTR){
+			close(lock);
+			return false;
+		}
+	}
+	
+	bool updated = mergeIndex(filepath, newRows);
+	close(lock);		// Releases the lock
+	return updated;
+}
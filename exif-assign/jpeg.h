@@ -0,0 +1,135 @@
+#include<vector>
+#include<cstring>
+#include<unistd.h>
+
+using namespace std;
+
+// JPEG Markers (second byte, after 0xFF)
+const unsigned char soiMarker = 0xD8;		// Start of Image
+const unsigned char eoiMarker = 0xD9;		// End of Image
+const unsigned char sosMarker = 0xDA;		// Start of Scan
+
+const size_t jpegReadSize = 4096;			// Bytes read at a time when reading a header from a file
+
+struct JpegSegment{
+	unsigned char marker;	// eg. 0xE1 for APP1
+	size_t offset;			// Offset of the 0xFF marker byte from the start of the file
+	unsigned short length;	// Segment length (including the 2 length bytes, excluding the marker)
+};
+
+// Returns true if marker is an APPn marker (0xE0 to 0xEF)
+bool isAPPnMarker(unsigned char marker){
+	return (marker & 0xF0) == 0xE0;
+}
+
+// The segments of a JPG from SOI up to (and including) the SOS segment header
+// The entropy coded scan data after SOS is never read
+// Headers are read from a file with small positioned reads (pread), or parsed from a
+// buffer that already holds the file
+class JpegHeader{
+	private:
+		int fd;								// File the header is read from (-1 if parsing a buffer)
+		vector<unsigned char> buffer;		// Bytes read from fd
+		const unsigned char* bytes;
+		size_t size;						// Bytes available
+		size_t bytesRead;
+		vector<JpegSegment> segments;
+		size_t sosOffset;
+		
+		// Makes sure bytes up to end are available, reading more from the file if needed
+		bool available(size_t end){
+			while(end > size){
+				if(fd < 0)
+					return false;
+				
+				buffer.resize(size + jpegReadSize);
+				ssize_t n = pread(fd, buffer.data() + size, jpegReadSize, size);
+				if(n <= 0)
+					return false;
+				
+				size += n;
+				bytesRead += n;
+				bytes = buffer.data();
+			}
+			return true;
+		}
+		
+		// Walks the segments from SOI until SOS; returns false if this is not a valid JPG
+		bool walk(){
+			if(!available(2) || bytes[0] != 0xFF || bytes[1] != soiMarker)
+				return false;
+			
+			size_t pos = 2;
+			while(available(pos + 2)){
+				if(bytes[pos] != 0xFF)
+					return false;
+				
+				// Markers may be preceded by any number of 0xFF fill bytes
+				if(bytes[pos + 1] == 0xFF){
+					pos++;
+					continue;
+				}
+				
+				JpegSegment segment;
+				segment.marker = bytes[pos + 1];
+				segment.offset = pos;
+				if(segment.marker == eoiMarker || !available(pos + 4))
+					return false;
+				segment.length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+				
+				if(!available(pos + 2 + segment.length))
+					return false;
+				segments.push_back(segment);
+				pos += 2 + segment.length;
+				
+				if(segment.marker == sosMarker){
+					sosOffset = segment.offset;
+					return true;
+				}
+			}
+			return false;
+		}
+	
+	public:
+		JpegHeader(){
+			fd = -1;
+			bytes = NULL;
+			size = 0;
+			bytesRead = 0;
+			sosOffset = 0;
+		}
+		
+		// Reads the header from an open file
+		bool read(int file){
+			fd = file;
+			bool valid = walk();
+			fd = -1;
+			return valid;
+		}
+		
+		// Parses the header from a buffer holding the file (the buffer must outlive this object)
+		bool parse(const unsigned char* file, size_t fileSize){
+			bytes = file;
+			size = fileSize;
+			return walk();
+		}
+		
+		vector<JpegSegment> getSegments(){
+			return segments;
+		}
+		
+		// Returns the offset of the SOS marker; everything before it is the header
+		size_t getSOSOffset(){
+			return sosOffset;
+		}
+		
+		// Returns the bytes of a segment (starting at its 0xFF marker byte)
+		const unsigned char* getSegmentBytes(JpegSegment segment){
+			return bytes + segment.offset;
+		}
+		
+		// Returns the number of bytes read from the file
+		size_t getBytesRead(){
+			return bytesRead;
+		}
+};
@@ -0,0 +1,339 @@
+#include<string>
+#include<vector>
+#include<map>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+#include<algorithm>
+#include<fstream>
+#include<cstring>
+#include<cstdlib>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/stat.h>
+#include<sys/sysmacros.h>
+#include<linux/fs.h>
+#include<linux/fiemap.h>
+
+using namespace std;
+
+// Device-aware I/O scheduling
+// Files are grouped by the device they are stored on (st_dev), and each device has its own
+// queue and concurrency limit, so a spinning disk is never read by more jobs than it can
+// seek between while SSDs are read in parallel. Files on rotational devices are read in
+// order of their physical offset on the disk. Reads and writes on the same device share
+// one set of slots, so a disk that is both input and output is never used by more jobs than
+// its limit.
+
+// Counting semaphore limiting the number of jobs using a device at once
+class DeviceSlots{
+	private:
+		int available;
+		mutex lock;
+		condition_variable released;
+	
+	public:
+		DeviceSlots(int slots){
+			available = slots;
+		}
+		
+		void acquire(){
+			unique_lock<mutex> guard(lock);
+			released.wait(guard, [this]{ return available > 0; });
+			available--;
+		}
+		
+		void release(){
+			lock_guard<mutex> guard(lock);
+			available++;
+			released.notify_one();
+		}
+};
+
+// Returns the device a file is stored on; for a file that does not exist yet (eg. an
+// output file), the device of its directory
+dev_t fileDevice(string filepath){
+	struct stat st;
+	if(stat(filepath.c_str(), &st) == 0)
+		return st.st_dev;
+	
+	size_t slash = filepath.find_last_of('/');
+	string directory = (slash == string::npos) ? "." : filepath.substr(0, slash);
+	if(stat(directory.c_str(), &st) == 0)
+		return st.st_dev;
+	
+	return 0;
+}
+
+// Returns true if a device is a rotational (spinning) disk, from its sysfs queue
+// Partitions do not have a queue, so the queue of the parent disk is used
+// Devices without a block device (eg. network filesystems, tmpfs) are not rotational
+bool isRotationalDevice(dev_t device){
+	string block = "/sys/dev/block/" + to_string(major(device)) + ":" + to_string(minor(device));
+	const char* queues[] = {"/queue/rotational", "/../queue/rotational"};
+	
+	for(int i = 0; i < 2; i++){
+		ifstream rotational(block + queues[i]);
+		int value;
+		if(rotational >> value)
+			return value == 1;
+	}
+	
+	return false;
+}
+
+// Returns the physical offset of the start of a file on its disk (FIEMAP); if it is not
+// available, the inode number is used, which usually follows allocation order
+unsigned long long physicalOffset(string filepath){
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd < 0)
+		return 0;
+	
+	// Request for the first extent only
+	struct fiemap* request = (struct fiemap*)calloc(1, sizeof(struct fiemap) + sizeof(struct fiemap_extent));
+	request->fm_length = ~0ULL;
+	request->fm_extent_count = 1;
+	
+	unsigned long long offset;
+	struct stat st;
+	if(ioctl(fd, FS_IOC_FIEMAP, request) == 0 && request->fm_mapped_extents > 0)
+		offset = request->fm_extents[0].fe_physical;
+	else
+		offset = (fstat(fd, &st) == 0) ? st.st_ino : 0;
+	
+	free(request);
+	close(fd);
+	return offset;
+}
+
+// Jobs reading from one device
+struct DeviceQueue{
+	dev_t device;
+	bool rotational;
+	int limit;						// Jobs run at once
+	vector<int> jobs;
+	vector<string> filepaths;		// Input filepath of each job
+	atomic<int> next;				// Position of the next job to run
+};
+
+class IOScheduler{
+	private:
+		CachePolicy policy;
+		int rotationalLimit;
+		int solidStateLimit;
+		map<dev_t, DeviceQueue*> queues;
+		map<dev_t, DeviceSlots*> deviceSlots;		// Read and write slots of each device
+		mutex deviceSlotsLock;
+		
+		// Returns the concurrency limit of a device
+		int deviceLimit(bool rotational){
+			return rotational ? rotationalLimit : solidStateLimit;
+		}
+		
+		// Waits for a slot on the device of a file; returns the slots, which must be released
+		// with release
+		DeviceSlots* acquire(string filepath){
+			dev_t device = fileDevice(filepath);
+			DeviceSlots* slots;
+			{
+				lock_guard<mutex> guard(deviceSlotsLock);
+				if(deviceSlots.count(device) == 0)
+					deviceSlots[device] = new DeviceSlots(deviceLimit(isRotationalDevice(device)));
+				slots = deviceSlots[device];
+			}
+			
+			slots->acquire();
+			return slots;
+		}
+		
+		// Runs the jobs of one queue; each worker takes the next job in the queue
+		// The next files in the queue are prefetched into the page cache (see CachePolicy)
+		void runQueue(DeviceQueue* queue, function<void(int)> work){
+			int position;
+			while((position = queue->next++) < queue->jobs.size()){
+				if(policy.readahead > 0 && !policy.direct){
+					int first = (position == 0) ? 1 : position + policy.readahead;
+					for(int ahead = first; ahead <= position + policy.readahead && ahead < queue->jobs.size(); ahead++)
+						prefetchFile(queue->filepaths.at(ahead));
+				}
+				
+				work(queue->jobs.at(position));
+			}
+		}
+	
+	public:
+		IOScheduler(CachePolicy cachePolicy, int rotationalJobs, int solidStateJobs){
+			policy = cachePolicy;
+			rotationalLimit = max(1, rotationalJobs);
+			solidStateLimit = max(1, solidStateJobs);
+		}
+		
+		~IOScheduler(){
+			for(auto& queue : queues)
+				delete queue.second;
+			for(auto& slots : deviceSlots)
+				delete slots.second;
+		}
+		
+		// Adds a job, queued on the device of its input file
+		void addJob(int job, string inFilepath){
+			dev_t device = fileDevice(inFilepath);
+			if(queues.count(device) == 0){
+				DeviceQueue* queue = new DeviceQueue();
+				queue->device = device;
+				queue->rotational = isRotationalDevice(device);
+				queue->limit = deviceLimit(queue->rotational);
+				queue->next = 0;
+				queues[device] = queue;
+			}
+			
+			queues[device]->jobs.push_back(job);
+			queues[device]->filepaths.push_back(inFilepath);
+		}
+		
+		// Returns the number of worker threads run (the sum of the device limits)
+		int getWorkerCount(){
+			int workers = 0;
+			for(auto& entry : queues)
+				workers += entry.second->limit;
+			return workers;
+		}
+		
+		// Prints each device queue
+		void printQueues(){
+			for(auto& entry : queues){
+				DeviceQueue* queue = entry.second;
+				printf("Device %u:%u (%s): %lu files, %d at a time\n", major(queue->device), minor(queue->device),
+					queue->rotational ? "rotational" : "non-rotational", queue->jobs.size(), queue->limit);
+			}
+		}
+		
+		// Runs every job; the queues of all devices run at the same time
+		void run(function<void(int)> work){
+			// Sort rotational queues by physical offset, so the disk reads in one sweep
+			for(auto& entry : queues){
+				DeviceQueue* queue = entry.second;
+				if(!queue->rotational)
+					continue;
+				
+				vector<pair<unsigned long long, int>> order;
+				for(int i = 0; i < queue->jobs.size(); i++)
+					order.push_back(make_pair(physicalOffset(queue->filepaths.at(i)), i));
+				sort(order.begin(), order.end());
+				
+				vector<int> jobs;
+				vector<string> filepaths;
+				for(int i = 0; i < order.size(); i++){
+					jobs.push_back(queue->jobs.at(order.at(i).second));
+					filepaths.push_back(queue->filepaths.at(order.at(i).second));
+				}
+				queue->jobs = jobs;
+				queue->filepaths = filepaths;
+			}
+			
+			vector<thread> workers;
+			for(auto& entry : queues){
+				for(int i = 0; i < entry.second->limit; i++)
+					workers.push_back(thread(&IOScheduler::runQueue, this, entry.second, work));
+			}
+			for(int i = 0; i < workers.size(); i++)
+				workers.at(i).join();
+		}
+		
+		// Waits for a slot to read an input file, or write an output file, on its device
+		// Returns the slots, which must be released with release once the file is read or written
+		// A job never holds more than one slot at a time (its input is read before its outputs
+		// are written), so jobs cannot wait on each other's slots
+		DeviceSlots* acquireRead(string inFilepath){
+			return acquire(inFilepath);
+		}
+		
+		DeviceSlots* acquireWrite(string outFilepath){
+			return acquire(outFilepath);
+		}
+		
+		void release(DeviceSlots* slots){
+			slots->release();
+		}
+};
+
+// Threads writing the outputs of frames, so that the outputs of a frame on different disks
+// are written at the same time
+// The threads are started once for the run, instead of once per output of each frame
+class WriterPool{
+	private:
+		vector<thread> writers;
+		deque<function<void()>> tasks;
+		mutex lock;
+		condition_variable queued;
+		bool stopping;
+		
+		// Runs queued writes until the pool is stopped
+		void runWriter(){
+			unique_lock<mutex> guard(lock);
+			while(true){
+				queued.wait(guard, [this]{ return stopping || !tasks.empty(); });
+				if(tasks.empty())
+					return;
+				
+				function<void()> task = tasks.front();
+				tasks.pop_front();
+				guard.unlock();
+				task();
+				guard.lock();
+			}
+		}
+	
+	public:
+		WriterPool(int threads){
+			stopping = false;
+			for(int i = 0; i < threads; i++)
+				writers.push_back(thread(&WriterPool::runWriter, this));
+		}
+		
+		~WriterPool(){
+			{
+				lock_guard<mutex> guard(lock);
+				stopping = true;
+			}
+			queued.notify_all();
+			for(size_t i = 0; i < writers.size(); i++)
+				writers.at(i).join();
+		}
+		
+		// Runs writes at the same time and returns once all have finished; the first write runs
+		// on the calling thread and the rest on the pool (or the calling thread if it has none)
+		void run(vector<function<void()>> writes){
+			if(writers.empty()){
+				for(size_t i = 0; i < writes.size(); i++)
+					writes.at(i)();
+				return;
+			}
+			
+			mutex doneLock;
+			condition_variable done;
+			size_t remaining = (writes.size() > 1) ? writes.size() - 1 : 0;
+			{
+				lock_guard<mutex> guard(lock);
+				for(size_t i = 1; i < writes.size(); i++){
+					function<void()> write = writes.at(i);
+					tasks.push_back([write, &doneLock, &done, &remaining](){
+						write();
+						lock_guard<mutex> guard(doneLock);
+						remaining--;
+						done.notify_one();
+					});
+				}
+			}
+			queued.notify_all();
+			
+			if(!writes.empty())
+				writes.at(0)();
+			unique_lock<mutex> guard(doneLock);
+			done.wait(guard, [&remaining]{ return remaining == 0; });
+		}
+};
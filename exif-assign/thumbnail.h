@@ -0,0 +1,798 @@
+#include<vector>
+#include<cmath>
+#include<cstring>
+#include<algorithm>
+
+using namespace std;
+
+// Thumbnail from the DC coefficients of a baseline JPG
+// The DC coefficient of each 8x8 block is 8 times the mean of the block, so the DC
+// coefficients alone are the image at 1/8 scale. The scan is Huffman decoded to find them,
+// but the AC coefficients are only skipped (never dequantized or transformed with an IDCT).
+// The 1/8 scale image is then reduced to a 160x120 thumbnail (letterboxed) and encoded as
+// a baseline JPG with the standard (Annex K) quantization and Huffman tables.
+// Progressive, lossless, arithmetic coded and 12-bit JPGs are not supported.
+
+// JPEG Markers (second byte, after 0xFF)
+const unsigned char sof0Marker = 0xC0;		// Start of Frame (baseline DCT)
+const unsigned char sof1Marker = 0xC1;		// Start of Frame (extended sequential DCT, Huffman)
+const unsigned char dhtMarker = 0xC4;		// Define Huffman Table
+const unsigned char dqtMarker = 0xDB;		// Define Quantization Table
+const unsigned char driMarker = 0xDD;		// Define Restart Interval
+const unsigned char rst0Marker = 0xD0;		// Restart (RST0 to RST7)
+
+const int thumbnailWidth = 160;
+const int thumbnailHeight = 120;
+const int thumbnailQualities[] = {75, 50, 25};		// Tried in order until the thumbnail fits
+const int huffmanLookupBits = 10;					// Codes up to this length are decoded with one lookup
+
+// Natural (row-major) index of each coefficient in zigzag order
+const unsigned char zigzagOrder[64] = {
+	0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Standard quantization tables (Annex K.1, K.2), in natural order
+const unsigned char luminanceQuantTable[64] = {
+	16, 11, 10, 16, 24,  40,  51,  61,
+	12, 12, 14, 19, 26,  58,  60,  55,
+	14, 13, 16, 24, 40,  57,  69,  56,
+	14, 17, 22, 29, 51,  87,  80,  62,
+	18, 22, 37, 56, 68,  109, 103, 77,
+	24, 35, 55, 64, 81,  104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99
+};
+const unsigned char chrominanceQuantTable[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Standard Huffman tables (Annex K.3 to K.6); number of codes of each length (1 to 16), then the values
+const unsigned char dcLuminanceCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const unsigned char dcLuminanceValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const unsigned char dcChrominanceCounts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const unsigned char dcChrominanceValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const unsigned char acLuminanceCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+const unsigned char acLuminanceValues[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+	0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+	0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+	0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA
+};
+const unsigned char acChrominanceCounts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const unsigned char acChrominanceValues[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+	0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+	0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+	0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+	0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+	0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA
+};
+
+// Huffman table for decoding, built from a DHT segment
+class HuffmanDecoder{
+	private:
+		unsigned char lookupLength[1 << huffmanLookupBits];		// Code length of each prefix (0 if the code is longer)
+		unsigned char lookupValue[1 << huffmanLookupBits];
+		unsigned char lookupSkip[1 << huffmanLookupBits];		// Code length plus the coefficient bits that follow (0 if longer)
+		int maxCode[17];			// Largest code of each length (-1 if none)
+		int valueOffset[17];		// Index in values of the codes of each length, minus the first code
+		unsigned char values[256];
+		int numValues;
+	
+	public:
+		HuffmanDecoder(){
+			numValues = 0;
+		}
+		
+		// Builds the table from the number of codes of each length and the values
+		// Returns false if the codes do not fit in 16 bits
+		bool build(const unsigned char counts[16], const unsigned char symbols[]){
+			memset(lookupLength, 0, sizeof(lookupLength));
+			memset(lookupSkip, 0, sizeof(lookupSkip));
+			numValues = 0;
+			
+			// Canonical codes; codes of each length follow the codes of the previous length
+			int code = 0;
+			for(int length = 1; length <= 16; length++){
+				valueOffset[length] = numValues - code;
+				for(int i = 0; i < counts[length - 1]; i++){
+					if(numValues >= 256 || code >= (1 << length))
+						return false;
+					values[numValues] = symbols[numValues];
+					
+					if(length <= huffmanLookupBits){
+						int first = code << (huffmanLookupBits - length);
+						for(int prefix = first; prefix < first + (1 << (huffmanLookupBits - length)); prefix++){
+							lookupLength[prefix] = length;
+							lookupValue[prefix] = symbols[numValues];
+							if(length + (symbols[numValues] & 0x0F) <= huffmanLookupBits)
+								lookupSkip[prefix] = length + (symbols[numValues] & 0x0F);
+						}
+					}
+					code++;
+					numValues++;
+				}
+				maxCode[length] = (counts[length - 1] == 0) ? -1 : code - 1;
+				code <<= 1;
+			}
+			return true;
+		}
+		
+		// Returns true if the table has been defined
+		bool isDefined(){
+			return numValues > 0;
+		}
+		
+		// Decodes the value of the code at the start of the next 16 bits of the scan
+		// Returns the value and sets length to the code length, or returns -1 if it is not a code
+		int decode(unsigned int bits, int& length){
+			int prefix = bits >> (16 - huffmanLookupBits);
+			if(lookupLength[prefix] != 0){
+				length = lookupLength[prefix];
+				return lookupValue[prefix];
+			}
+			
+			for(length = huffmanLookupBits + 1; length <= 16; length++){
+				int code = bits >> (16 - length);
+				if(code <= maxCode[length])
+					return values[code + valueOffset[length]];
+			}
+			return -1;
+		}
+		
+		// Decodes the AC code at the start of the next 16 bits of the scan, if it and the
+		// coefficient bits that follow fit in the lookup
+		// Returns the value and sets length to the number of bits to skip, or returns -1
+		int decodeAndSkip(unsigned int bits, int& length){
+			int prefix = bits >> (16 - huffmanLookupBits);
+			length = lookupSkip[prefix];
+			return (length != 0) ? lookupValue[prefix] : -1;
+		}
+};
+
+// Reads the entropy coded data of a scan, MSB first
+// Stuffed zero bytes (0xFF00) are removed; at a marker, zero bits are returned until the
+// marker is passed with nextRestart
+class ScanBitReader{
+	private:
+		const unsigned char* bytes;
+		size_t size;
+		size_t pos;
+		unsigned long long buffer;		// Bits not yet read, from the most significant bit
+		int count;						// Bits in buffer
+		bool atMarker;
+		
+		// Fills the buffer to at least 57 bits
+		void fill(){
+			// Fast path; whole bytes from the next 8 if none of them is 0xFF
+			if(!atMarker && pos + 8 <= size){
+				unsigned long long chunk;
+				memcpy(&chunk, bytes + pos, 8);
+				unsigned long long inverted = ~chunk;
+				if(((inverted - 0x0101010101010101ULL) & ~inverted & 0x8080808080808080ULL) == 0){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+					chunk = __builtin_bswap64(chunk);
+#endif
+					int n = (64 - count) / 8;
+					if(n < 8)
+						chunk &= ~(~0ULL >> (n * 8));
+					buffer |= chunk >> count;
+					count += n * 8;
+					pos += n;
+					return;
+				}
+			}
+			
+			while(count <= 56){
+				unsigned long long byte = 0;
+				if(!atMarker && pos < size){
+					byte = bytes[pos];
+					if(byte != 0xFF)
+						pos++;
+					else if(pos + 1 < size && bytes[pos + 1] == 0x00)
+						pos += 2;
+					else{
+						atMarker = true;
+						byte = 0;
+					}
+				}
+				buffer |= byte << (56 - count);
+				count += 8;
+			}
+		}
+	
+	public:
+		ScanBitReader(const unsigned char scan[], size_t scanSize){
+			bytes = scan;
+			size = scanSize;
+			pos = 0;
+			buffer = 0;
+			count = 0;
+			atMarker = false;
+		}
+		
+		// Returns the next 16 bits without reading them
+		unsigned int peek16(){
+			if(count < 16)
+				fill();
+			return buffer >> 48;
+		}
+		
+		// Skips bits (up to 16) that have been peeked
+		void skip(int bits){
+			buffer <<= bits;
+			count -= bits;
+		}
+		
+		// Reads bits (up to 16)
+		unsigned int getBits(int bits){
+			if(bits == 0)
+				return 0;
+			if(count < bits)
+				fill();
+			unsigned int value = buffer >> (64 - bits);
+			skip(bits);
+			return value;
+		}
+		
+		// Discards the rest of the current byte and reads past the next restart marker
+		// Returns false if there is no restart marker
+		bool nextRestart(){
+			buffer = 0;
+			count = 0;
+			while(pos + 1 < size && bytes[pos] == 0xFF && bytes[pos + 1] == 0xFF)		// Fill bytes
+				pos++;
+			if(pos + 1 >= size || bytes[pos] != 0xFF || (bytes[pos + 1] & 0xF8) != rst0Marker)
+				return false;
+			
+			pos += 2;
+			atMarker = false;
+			return true;
+		}
+};
+
+// Returns the signed value of a coefficient from its category (bit length) and bits
+int extendCoefficient(unsigned int bits, int category){
+	if(category == 0)
+		return 0;
+	return (bits < (1u << (category - 1))) ? (int)bits - (1 << category) + 1 : (int)bits;
+}
+
+// One component (eg. Y, Cb or Cr) of a JPG frame
+struct FrameComponent{
+	unsigned char id = 0;
+	int h = 1;				// Horizontal sampling factor
+	int v = 1;				// Vertical sampling factor
+	int quantTable = 0;
+	int dcTable = 0;
+	int acTable = 0;
+	int blocksWide = 0;		// Blocks in the scan (including the blocks padding the last MCU)
+	int blocksHigh = 0;
+	vector<int> dc;			// Dequantized DC coefficient of each block
+	int predictor = 0;		// DC coefficient of the previous block (DC coefficients are coded as differences)
+};
+
+// Image at 1/8 scale from the DC coefficients of a baseline JPG
+class DCImage{
+	private:
+		int width;			// Image width in pixels
+		int height;
+		int hMax;			// Largest sampling factors
+		int vMax;
+		int restartInterval;	// MCUs between restart markers (0 for none)
+		vector<FrameComponent> components;
+		unsigned short quantDC[4];		// DC quantization value of each table
+		HuffmanDecoder dcTables[4];
+		HuffmanDecoder acTables[4];
+		
+		// Reads the tables and frame from the header segments; returns false if the JPG is
+		// not a baseline (or extended sequential, 8-bit, Huffman coded) JPG
+		bool readSegments(JpegHeader& header){
+			vector<JpegSegment> segments = header.getSegments();
+			bool frameFound = false;
+			for(int i = 0; i < segments.size(); i++){
+				const unsigned char* segment = header.getSegmentBytes(segments.at(i)) + 4;		// After marker and length
+				int length = segments.at(i).length - 2;
+				unsigned char marker = segments.at(i).marker;
+				
+				// Quantization tables; only the DC value (first in zigzag order) is needed
+				if(marker == dqtMarker){
+					for(int pos = 0; pos < length;){
+						int precision = segment[pos] >> 4;
+						int table = segment[pos] & 0x0F;
+						int tableSize = 1 + 64 * (precision + 1);
+						if(table > 3 || pos + tableSize > length)
+							return false;
+						quantDC[table] = (precision == 0) ? segment[pos + 1] : (segment[pos + 1] << 8) | segment[pos + 2];
+						pos += tableSize;
+					}
+				}
+				
+				// Huffman tables
+				else if(marker == dhtMarker){
+					for(int pos = 0; pos < length;){
+						int tableClass = segment[pos] >> 4;
+						int table = segment[pos] & 0x0F;
+						if(tableClass > 1 || table > 3 || pos + 17 > length)
+							return false;
+						
+						int numValues = 0;
+						for(int j = 0; j < 16; j++)
+							numValues += segment[pos + 1 + j];
+						if(pos + 17 + numValues > length)
+							return false;
+						
+						HuffmanDecoder& decoder = (tableClass == 0) ? dcTables[table] : acTables[table];
+						if(!decoder.build(segment + pos + 1, segment + pos + 17))
+							return false;
+						pos += 17 + numValues;
+					}
+				}
+				
+				else if(marker == driMarker && length >= 2){
+					restartInterval = (segment[0] << 8) | segment[1];
+				}
+				
+				// Frame; any other SOFn (progressive, lossless, arithmetic coded) is not supported
+				else if(marker == sof0Marker || marker == sof1Marker){
+					if(length < 6 || segment[0] != 8)
+						return false;
+					height = (segment[1] << 8) | segment[2];
+					width = (segment[3] << 8) | segment[4];
+					int numComponents = segment[5];
+					if(width == 0 || height == 0 || (numComponents != 1 && numComponents != 3) || length < 6 + numComponents * 3)
+						return false;
+					
+					hMax = 1;
+					vMax = 1;
+					for(int c = 0; c < numComponents; c++){
+						FrameComponent component;
+						component.id = segment[6 + c * 3];
+						component.h = segment[7 + c * 3] >> 4;
+						component.v = segment[7 + c * 3] & 0x0F;
+						component.quantTable = segment[8 + c * 3] & 0x03;
+						if(component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4)
+							return false;
+						hMax = max(hMax, component.h);
+						vMax = max(vMax, component.v);
+						components.push_back(component);
+					}
+					frameFound = true;
+				}
+				else if(marker >= 0xC1 && marker <= 0xCF && marker != dhtMarker && marker != 0xC8 && marker != 0xCC){
+					return false;
+				}
+				
+				// First scan; it must contain every component (an interleaved scan, or the only
+				// component of a greyscale JPG)
+				else if(marker == sosMarker){
+					if(!frameFound || length < 1 || segment[0] != components.size() || length < 1 + segment[0] * 2)
+						return false;
+					for(int c = 0; c < components.size(); c++){
+						if(segment[1 + c * 2] != components.at(c).id)
+							return false;
+						components.at(c).dcTable = segment[2 + c * 2] >> 4;
+						components.at(c).acTable = segment[2 + c * 2] & 0x0F;
+						if(	components.at(c).dcTable > 3 || components.at(c).acTable > 3 ||
+							!dcTables[components.at(c).dcTable].isDefined() || !acTables[components.at(c).acTable].isDefined())
+							return false;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+		
+		// Decodes one block, keeping only its DC coefficient
+		bool decodeBlock(ScanBitReader& scan, FrameComponent& component, int& dc){
+			int length;
+			int category = dcTables[component.dcTable].decode(scan.peek16(), length);
+			if(category < 0 || category > 11)
+				return false;
+			scan.skip(length);
+			component.predictor += extendCoefficient(scan.getBits(category), category);
+			dc = component.predictor * quantDC[component.quantTable];
+			
+			// Skip the AC coefficients; each code is a zero run length and a category
+			HuffmanDecoder& ac = acTables[component.acTable];
+			for(int k = 1; k < 64; k++){
+				unsigned int bits = scan.peek16();
+				int symbol = ac.decodeAndSkip(bits, length);
+				if(symbol >= 0){
+					scan.skip(length);		// Code and coefficient bits together
+				}
+				else{
+					symbol = ac.decode(bits, length);
+					if(symbol < 0)
+						return false;
+					scan.skip(length);
+					scan.getBits(symbol & 0x0F);
+				}
+				
+				int run = symbol >> 4;
+				if((symbol & 0x0F) == 0){
+					if(run != 15)		// End of block
+						break;
+					k += 15;			// 16 zeros
+				}
+				else{
+					k += run;
+				}
+			}
+			return true;
+		}
+	
+	public:
+		DCImage(){
+			width = 0;
+			height = 0;
+			hMax = 1;
+			vMax = 1;
+			restartInterval = 0;
+			memset(quantDC, 0, sizeof(quantDC));
+		}
+		
+		// Decodes the DC coefficients of a JPG held in memory
+		// Returns false if the JPG is not supported or its scan is invalid
+		bool decode(const unsigned char jpg[], size_t size, JpegHeader& header){
+			if(!readSegments(header))
+				return false;
+			
+			// MCU layout; a greyscale scan is not interleaved, so each MCU is one block
+			int mcusWide, mcusHigh;
+			if(components.size() == 1){
+				components.at(0).h = 1;
+				components.at(0).v = 1;
+				hMax = 1;
+				vMax = 1;
+			}
+			mcusWide = (width + 8 * hMax - 1) / (8 * hMax);
+			mcusHigh = (height + 8 * vMax - 1) / (8 * vMax);
+			for(int c = 0; c < components.size(); c++){
+				FrameComponent& component = components.at(c);
+				component.blocksWide = mcusWide * component.h;
+				component.blocksHigh = mcusHigh * component.v;
+				component.dc.assign(component.blocksWide * component.blocksHigh, 0);
+				component.predictor = 0;
+			}
+			
+			// Entropy coded data starts after the SOS segment
+			JpegSegment sos = header.getSegments().back();
+			size_t scanStart = sos.offset + 2 + sos.length;
+			if(scanStart > size)
+				return false;
+			ScanBitReader scan(jpg + scanStart, size - scanStart);
+			
+			int numMCUs = mcusWide * mcusHigh;
+			for(int mcu = 0; mcu < numMCUs; mcu++){
+				// DC predictions restart at each restart marker
+				if(restartInterval > 0 && mcu > 0 && mcu % restartInterval == 0){
+					if(!scan.nextRestart())
+						return false;
+					for(int c = 0; c < components.size(); c++)
+						components.at(c).predictor = 0;
+				}
+				
+				int mcuX = mcu % mcusWide;
+				int mcuY = mcu / mcusWide;
+				for(int c = 0; c < components.size(); c++){
+					FrameComponent& component = components.at(c);
+					for(int by = 0; by < component.v; by++){
+						for(int bx = 0; bx < component.h; bx++){
+							int block = (mcuY * component.v + by) * component.blocksWide + (mcuX * component.h + bx);
+							if(!decodeBlock(scan, component, component.dc.at(block)))
+								return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+		
+		// Returns the width of the 1/8 scale image (one pixel per full resolution block)
+		int getWidth(){
+			return (width + 7) / 8;
+		}
+		
+		int getHeight(){
+			return (height + 7) / 8;
+		}
+		
+		int getNumComponents(){
+			return components.size();
+		}
+		
+		// Returns a component of the 1/8 scale image (getWidth x getHeight pixels)
+		// Subsampled components are sampled at the block covering each pixel
+		vector<unsigned char> getPlane(int c){
+			FrameComponent& component = components.at(c);
+			vector<unsigned char> plane(getWidth() * getHeight());
+			for(int y = 0; y < getHeight(); y++){
+				const int* row = component.dc.data() + (y * component.v / vMax) * component.blocksWide;
+				for(int x = 0; x < getWidth(); x++){
+					int value = row[x * component.h / hMax] / 8 + 128;		// DC = 8 * (mean - 128)
+					plane[y * getWidth() + x] = min(255, max(0, value));
+				}
+			}
+			return plane;
+		}
+};
+
+// Huffman table for encoding; code and length of each value
+struct HuffmanEncoder{
+	unsigned short code[256];
+	unsigned char length[256];
+	
+	void build(const unsigned char counts[16], const unsigned char symbols[]){
+		memset(length, 0, sizeof(length));
+		int value = 0, nextCode = 0;
+		for(int bits = 1; bits <= 16; bits++){
+			for(int i = 0; i < counts[bits - 1]; i++){
+				code[symbols[value]] = nextCode++;
+				length[symbols[value]] = bits;
+				value++;
+			}
+			nextCode <<= 1;
+		}
+	}
+};
+
+// Writes entropy coded data, MSB first, stuffing a zero byte after each 0xFF
+class ScanBitWriter{
+	private:
+		vector<unsigned char>& bytes;
+		unsigned int buffer;
+		int count;
+	
+	public:
+		ScanBitWriter(vector<unsigned char>& output) : bytes(output){
+			buffer = 0;
+			count = 0;
+		}
+		
+		void write(unsigned int value, int bits){
+			for(int i = bits - 1; i >= 0; i--){
+				buffer = (buffer << 1) | ((value >> i) & 1);
+				if(++count == 8){
+					bytes.push_back(buffer);
+					if(buffer == 0xFF)
+						bytes.push_back(0x00);
+					buffer = 0;
+					count = 0;
+				}
+			}
+		}
+		
+		// Pads the last byte with 1 bits
+		void flush(){
+			if(count > 0)
+				write(0x7F, 8 - count);
+		}
+};
+
+// Returns the category (bit length) of a coefficient
+int coefficientCategory(int value){
+	int category = 0;
+	for(value = abs(value); value > 0; value >>= 1)
+		category++;
+	return category;
+}
+
+// Appends a marker and the length of its segment (length of data + 2)
+void appendSegmentHeader(vector<unsigned char>& jpg, unsigned char marker, int dataLength){
+	jpg.push_back(0xFF);
+	jpg.push_back(marker);
+	jpg.push_back((dataLength + 2) >> 8);
+	jpg.push_back((dataLength + 2) & 0xFF);
+}
+
+// Appends a DHT table
+void appendHuffmanTable(vector<unsigned char>& jpg, int tableClass, int table, const unsigned char counts[16],
+		const unsigned char symbols[], int numSymbols){
+	jpg.push_back((tableClass << 4) | table);
+	jpg.insert(jpg.end(), counts, counts + 16);
+	jpg.insert(jpg.end(), symbols, symbols + numSymbols);
+}
+
+// Encodes planes (Y, or Y, Cb and Cr; each width x height, multiples of 8) as a baseline
+// JPG with 1x1 sampling and the standard tables scaled to quality (1 to 100)
+vector<unsigned char> encodeJpeg(vector<vector<unsigned char>>& planes, int width, int height, int quality){
+	int numComponents = planes.size();
+	
+	// Quantization tables scaled by quality (as libjpeg), in natural order
+	int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+	unsigned char quantTables[2][64];
+	for(int i = 0; i < 64; i++){
+		quantTables[0][i] = min(255, max(1, (luminanceQuantTable[i] * scale + 50) / 100));
+		quantTables[1][i] = min(255, max(1, (chrominanceQuantTable[i] * scale + 50) / 100));
+	}
+	
+	HuffmanEncoder dcTables[2], acTables[2];
+	dcTables[0].build(dcLuminanceCounts, dcLuminanceValues);
+	dcTables[1].build(dcChrominanceCounts, dcChrominanceValues);
+	acTables[0].build(acLuminanceCounts, acLuminanceValues);
+	acTables[1].build(acChrominanceCounts, acChrominanceValues);
+	
+	// DCT basis: cosines[u][x] = C(u) / 2 * cos((2x + 1) * u * pi / 16)
+	float cosines[8][8];
+	for(int u = 0; u < 8; u++){
+		for(int x = 0; x < 8; x++)
+			cosines[u][x] = ((u == 0) ? sqrt(0.5) : 1.0) / 2.0 * cos((2 * x + 1) * u * M_PI / 16.0);
+	}
+	
+	vector<unsigned char> jpg = {0xFF, soiMarker};
+	
+	// DQT
+	appendSegmentHeader(jpg, dqtMarker, (numComponents == 1 ? 1 : 2) * 65);
+	for(int t = 0; t < (numComponents == 1 ? 1 : 2); t++){
+		jpg.push_back(t);
+		for(int k = 0; k < 64; k++)
+			jpg.push_back(quantTables[t][zigzagOrder[k]]);
+	}
+	
+	// SOF0
+	appendSegmentHeader(jpg, sof0Marker, 6 + numComponents * 3);
+	jpg.insert(jpg.end(), {8, (unsigned char)(height >> 8), (unsigned char)(height & 0xFF),
+		(unsigned char)(width >> 8), (unsigned char)(width & 0xFF), (unsigned char)numComponents});
+	for(int c = 0; c < numComponents; c++)
+		jpg.insert(jpg.end(), {(unsigned char)(c + 1), 0x11, (unsigned char)(c == 0 ? 0 : 1)});
+	
+	// DHT
+	appendSegmentHeader(jpg, dhtMarker, (numComponents == 1 ? 1 : 2) * (17 * 2 + 12 + 162));
+	appendHuffmanTable(jpg, 0, 0, dcLuminanceCounts, dcLuminanceValues, 12);
+	appendHuffmanTable(jpg, 1, 0, acLuminanceCounts, acLuminanceValues, 162);
+	if(numComponents > 1){
+		appendHuffmanTable(jpg, 0, 1, dcChrominanceCounts, dcChrominanceValues, 12);
+		appendHuffmanTable(jpg, 1, 1, acChrominanceCounts, acChrominanceValues, 162);
+	}
+	
+	// SOS
+	appendSegmentHeader(jpg, sosMarker, 1 + numComponents * 2 + 3);
+	jpg.push_back(numComponents);
+	for(int c = 0; c < numComponents; c++)
+		jpg.insert(jpg.end(), {(unsigned char)(c + 1), (unsigned char)(c == 0 ? 0x00 : 0x11)});
+	jpg.insert(jpg.end(), {0, 63, 0});
+	
+	// Scan; each MCU is one block of each component
+	ScanBitWriter scan(jpg);
+	int predictors[3] = {0, 0, 0};
+	for(int by = 0; by < height / 8; by++){
+		for(int bx = 0; bx < width / 8; bx++){
+			for(int c = 0; c < numComponents; c++){
+				int t = (c == 0) ? 0 : 1;
+				
+				// Forward DCT of the level shifted block (rows, then columns)
+				float block[8][8], rows[8][8];
+				for(int y = 0; y < 8; y++){
+					for(int x = 0; x < 8; x++)
+						block[y][x] = planes.at(c).at((by * 8 + y) * width + bx * 8 + x) - 128.0f;
+				}
+				for(int y = 0; y < 8; y++){
+					for(int u = 0; u < 8; u++){
+						float sum = 0;
+						for(int x = 0; x < 8; x++)
+							sum += cosines[u][x] * block[y][x];
+						rows[y][u] = sum;
+					}
+				}
+				
+				int coefficients[64];
+				for(int v = 0; v < 8; v++){
+					for(int u = 0; u < 8; u++){
+						float sum = 0;
+						for(int y = 0; y < 8; y++)
+							sum += cosines[v][y] * rows[y][u];
+						coefficients[v * 8 + u] = (int)lround(sum / quantTables[t][v * 8 + u]);
+					}
+				}
+				
+				// DC difference
+				int diff = coefficients[0] - predictors[c];
+				predictors[c] = coefficients[0];
+				int category = coefficientCategory(diff);
+				scan.write(dcTables[t].code[category], dcTables[t].length[category]);
+				scan.write((diff < 0) ? diff - 1 : diff, category);
+				
+				// AC coefficients in zigzag order, as (zero run, category) codes
+				int run = 0;
+				for(int k = 1; k < 64; k++){
+					int value = coefficients[zigzagOrder[k]];
+					if(value == 0){
+						run++;
+						continue;
+					}
+					for(; run >= 16; run -= 16)
+						scan.write(acTables[t].code[0xF0], acTables[t].length[0xF0]);		// 16 zeros
+					category = coefficientCategory(value);
+					int symbol = (run << 4) | category;
+					scan.write(acTables[t].code[symbol], acTables[t].length[symbol]);
+					scan.write((value < 0) ? value - 1 : value, category);
+					run = 0;
+				}
+				if(run > 0)
+					scan.write(acTables[t].code[0x00], acTables[t].length[0x00]);		// End of block
+			}
+		}
+	}
+	scan.flush();
+	
+	jpg.push_back(0xFF);
+	jpg.push_back(eoiMarker);
+	return jpg;
+}
+
+// Creates a 160x120 JPG thumbnail from the DC coefficients of a JPG held in memory
+// The image is scaled to fit, keeping its aspect ratio, and centred on a black background
+// The quality is lowered until the thumbnail fits in maxSize; if it never fits, the smallest
+// thumbnail is returned (the caller checks its size)
+// Returns false if the JPG is not supported
+bool createThumbnail(const unsigned char jpg[], size_t size, JpegHeader& header, vector<unsigned char>& thumbnail,
+		size_t maxSize){
+	DCImage image;
+	if(!image.decode(jpg, size, header))
+		return false;
+	
+	// Size of the scaled image within the thumbnail
+	int sourceWidth = image.getWidth();
+	int sourceHeight = image.getHeight();
+	int scaledWidth = thumbnailWidth;
+	int scaledHeight = thumbnailHeight;
+	if(sourceWidth * thumbnailHeight >= sourceHeight * thumbnailWidth)
+		scaledHeight = max(1, (int)lround((double)thumbnailWidth * sourceHeight / sourceWidth));
+	else
+		scaledWidth = max(1, (int)lround((double)thumbnailHeight * sourceWidth / sourceHeight));
+	int left = (thumbnailWidth - scaledWidth) / 2;
+	int top = (thumbnailHeight - scaledHeight) / 2;
+	
+	// Box filter; each thumbnail pixel is the mean of the pixels of the 1/8 scale image it covers
+	vector<vector<unsigned char>> planes;
+	for(int c = 0; c < image.getNumComponents(); c++){
+		vector<unsigned char> source = image.getPlane(c);
+		vector<unsigned char> plane(thumbnailWidth * thumbnailHeight, (c == 0) ? 0 : 128);
+		for(int y = 0; y < scaledHeight; y++){
+			int y0 = y * sourceHeight / scaledHeight;
+			int y1 = max(y0 + 1, (y + 1) * sourceHeight / scaledHeight);
+			for(int x = 0; x < scaledWidth; x++){
+				int x0 = x * sourceWidth / scaledWidth;
+				int x1 = max(x0 + 1, (x + 1) * sourceWidth / scaledWidth);
+				int sum = 0;
+				for(int sy = y0; sy < y1; sy++){
+					for(int sx = x0; sx < x1; sx++)
+						sum += source[sy * sourceWidth + sx];
+				}
+				plane[(top + y) * thumbnailWidth + left + x] = sum / ((y1 - y0) * (x1 - x0));
+			}
+		}
+		planes.push_back(plane);
+	}
+	
+	// Lower the quality until the thumbnail fits
+	for(int i = 0; i < sizeof(thumbnailQualities) / sizeof(int); i++){
+		thumbnail = encodeJpeg(planes, thumbnailWidth, thumbnailHeight, thumbnailQualities[i]);
+		if(thumbnail.size() <= maxSize)
+			break;
+	}
+	return true;
+}
@@ -0,0 +1,190 @@
+// Pipeline tracing, exported as Chrome trace event JSON (chrome://tracing or ui.perfetto.dev)
+// Tracing is compiled in with -DFILM_EXIF_TRACE; otherwise the macros expand to nothing
+//
+// TRACE_SCOPE(name)			- Records a span from this line to the end of the enclosing scope
+// TRACE_FRAME(name, file)		- Same as TRACE_SCOPE, with the frame's filename attached to the span
+// TRACE_EXPORT(path)			- Writes all recorded spans to a JSON file; returns false if disabled
+
+#ifdef FILM_EXIF_TRACE
+
+#include<atomic>
+#include<chrono>
+#include<fstream>
+#include<mutex>
+#include<string>
+#include<vector>
+#include<cstring>
+
+using namespace std;
+
+const int traceBufferSize = 4096;	// Spans kept per thread; oldest spans are overwritten
+const int traceDetailSize = 48;		// Characters of span detail (eg. filename) kept per span
+
+struct TraceEvent{
+	const char* name;
+	char detail[traceDetailSize];
+	long long start;		// ns since traceEpoch
+	long long duration;		// ns
+};
+
+const chrono::steady_clock::time_point traceEpoch = chrono::steady_clock::now();
+
+// Returns nanoseconds since traceEpoch
+long long traceNow(){
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceEpoch).count();
+}
+
+// Copies the end of a detail string (the distinguishing part of a path) into a span
+// Characters that would need escaping in JSON are replaced
+void traceCopyDetail(char dest[], const char* detail){
+	size_t length = strlen(detail);
+	if(length >= traceDetailSize)
+		detail += length - (traceDetailSize - 1);
+	strncpy(dest, detail, traceDetailSize);
+	
+	for(int i = 0; dest[i] != '\0'; i++)
+		if(dest[i] == '"' || dest[i] == '\\' || (unsigned char)dest[i] < ' ')
+			dest[i] = '_';
+}
+
+// Ring buffer of spans written only by its owning thread
+// The writer never locks; head is published with release ordering so the exporter can read
+// every span written before it
+class TraceBuffer{
+	private:
+		TraceEvent events[traceBufferSize];
+		atomic<unsigned long> head;
+		int threadID;
+	
+	public:
+		TraceBuffer(int id){
+			head = 0;
+			threadID = id;
+		}
+		
+		// Adds a span, overwriting the oldest span if the buffer is full
+		void push(const char* name, const char* detail, long long start, long long end){
+			unsigned long h = head.load(memory_order_relaxed);
+			TraceEvent& event = events[h % traceBufferSize];
+			
+			event.name = name;
+			event.start = start;
+			event.duration = end - start;
+			memcpy(event.detail, detail, traceDetailSize);
+			
+			head.store(h + 1, memory_order_release);
+		}
+		
+		// Appends the buffered spans as trace event JSON objects
+		void exportEvents(string& json, bool& first){
+			unsigned long h = head.load(memory_order_acquire);
+			unsigned long begin = (h > traceBufferSize) ? h - traceBufferSize : 0;
+			
+			char line[256];
+			for(unsigned long i = begin; i < h; i++){
+				TraceEvent& event = events[i % traceBufferSize];
+				snprintf(line, sizeof(line),
+					"%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":\"%s\"}}",
+					first ? "" : ",", event.name, threadID, event.start / 1000.0, event.duration / 1000.0, event.detail);
+				json.append(line);
+				first = false;
+			}
+		}
+};
+
+// Buffers of every thread that has recorded a span; the lock is only taken once per thread
+// Buffers of threads that have exited are free, and are reused by the next new thread, so
+// short-lived threads do not each allocate a buffer. A reused buffer keeps the spans of its
+// previous thread for the exporter (until they are overwritten), under the same thread ID.
+mutex traceBuffersLock;
+vector<TraceBuffer*> traceBuffers;
+vector<TraceBuffer*> traceFreeBuffers;
+
+// Owns a thread's buffer, and frees it for reuse when the thread exits
+struct TraceBufferOwner{
+	TraceBuffer* buffer = NULL;
+	
+	~TraceBufferOwner(){
+		if(buffer == NULL)
+			return;
+		
+		lock_guard<mutex> lock(traceBuffersLock);
+		traceFreeBuffers.push_back(buffer);
+	}
+};
+
+// Returns the calling thread's buffer, taking a free buffer or registering a new one on first use
+TraceBuffer* traceThreadBuffer(){
+	thread_local TraceBufferOwner owner;
+	
+	if(owner.buffer == NULL){
+		lock_guard<mutex> lock(traceBuffersLock);
+		if(!traceFreeBuffers.empty()){
+			owner.buffer = traceFreeBuffers.back();
+			traceFreeBuffers.pop_back();
+		}
+		else{
+			owner.buffer = new TraceBuffer(traceBuffers.size() + 1);
+			traceBuffers.push_back(owner.buffer);
+		}
+	}
+	
+	return owner.buffer;
+}
+
+// Records a span for the lifetime of the object
+class TraceScope{
+	private:
+		const char* name;
+		char detail[traceDetailSize];
+		long long start;
+	
+	public:
+		TraceScope(const char* spanName, const string& spanDetail = ""){
+			name = spanName;
+			traceCopyDetail(detail, spanDetail.c_str());
+			start = traceNow();
+		}
+		
+		~TraceScope(){
+			traceThreadBuffer()->push(name, detail, start, traceNow());
+		}
+};
+
+// Writes the spans of every thread to a Chrome trace event JSON file
+// Should be called after worker threads have finished
+bool traceExport(string filepath){
+	string json = "{\"traceEvents\":[";
+	bool first = true;
+	
+	{
+		lock_guard<mutex> lock(traceBuffersLock);
+		for(int i = 0; i < traceBuffers.size(); i++)
+			traceBuffers.at(i)->exportEvents(json, first);
+	}
+	json.append("\n]}\n");
+	
+	ofstream trace(filepath, ios::trunc);
+	if(!trace.is_open()){
+		perror("Could not write trace file");
+		return false;
+	}
+	trace << json;
+	trace.close();
+	
+	return true;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FRAME(name, file) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, file)
+#define TRACE_EXPORT(path) traceExport(path)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_FRAME(name, file)
+#define TRACE_EXPORT(path) (false)
+
+#endif
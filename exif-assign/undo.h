@@ -0,0 +1,204 @@
+#include<string>
+#include<vector>
+#include<mutex>
+#include<condition_variable>
+#include<climits>
+#include<cstdlib>
+#include<cstring>
+#include<cstdio>
+#include<cerrno>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+
+#include "hash.h"
+
+using namespace std;
+
+// Undo log of files overwritten by a run (-o)
+// Only the header (the bytes before SOS) of an overwritten file is changed, so the original
+// header is all that is needed to restore it. Each record is written to disk before its file
+// is overwritten. Records added while the log is being synced are synced together by the
+// next fdatasync (group commit), so workers do not wait for one sync each.
+//
+// File layout (all values in host byte order):
+// UndoLogHeader
+// Records:
+//		UndoRecordHeader
+//		path (pathLength characters, absolute)
+//		original header (headerSize bytes, SOI up to SOS)
+
+const char undoMagic[8] = {'F', 'X', 'U', 'N', 'D', 'O', '0', '1'};
+const unsigned int undoByteOrder = 0x01020304;	// Detects a log written on a host with different byte order
+
+const unsigned int undoXXH3 = 1;		// Fingerprint hash (see hash.h)
+
+struct UndoLogHeader{
+	char magic[8];
+	unsigned int byteOrder;
+	unsigned int hash;		// Fingerprint hash (undoXXH3)
+};
+
+struct UndoRecordHeader{
+	unsigned long long fileSize;		// Size of the original file
+	unsigned long long headerSize;		// Bytes before SOS
+	unsigned long long fingerprint;		// Hash of the image data (SOS to end of file)
+	unsigned int pathLength;
+	unsigned int reserved;
+};
+
+// One overwritten file
+struct UndoRecord{
+	string path;
+	unsigned long long fileSize;
+	unsigned long long fingerprint;
+	vector<unsigned char> header;
+};
+
+// Writes all bytes to a file; returns false if they could not be written
+bool writeAll(int fd, const void* data, size_t length){
+	const char* bytes = (const char*)data;
+	size_t total = 0;
+	while(total < length){
+		ssize_t n = write(fd, bytes + total, length - total);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		total += n;
+	}
+	return true;
+}
+
+class UndoLog{
+	private:
+		int fd;
+		mutex lock;		// Records are added by every scheduler worker
+		condition_variable syncDone;
+		unsigned long recordsWritten;	// Records written to the log
+		unsigned long recordsSynced;	// Records known to be on disk
+		bool syncing;					// A worker is syncing the log
+		int error;						// errno of the first failed write or sync (0 if none)
+	
+	public:
+		UndoLog(){
+			fd = -1;
+			recordsWritten = 0;
+			recordsSynced = 0;
+			syncing = false;
+			error = 0;
+		}
+		
+		~UndoLog(){
+			if(fd >= 0)
+				close(fd);
+		}
+		
+		// Creates a new log; an existing file (eg. the log of an earlier run) is never replaced
+		bool create(string filepath){
+			fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if(fd < 0)
+				return false;
+			
+			UndoLogHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, undoMagic, sizeof(undoMagic));
+			header.byteOrder = undoByteOrder;
+			header.hash = undoXXH3;
+			return writeAll(fd, &header, sizeof(header)) && fdatasync(fd) == 0;
+		}
+		
+		// Records the original header of a file that is about to be overwritten
+		// file holds the whole original file; returns once the record is on disk
+		bool addRecord(string filepath, const unsigned char file[], size_t fileSize, size_t sosOffset){
+			char* resolved = realpath(filepath.c_str(), NULL);
+			if(resolved == NULL)
+				return false;
+			string path = resolved;
+			free(resolved);
+			
+			UndoRecordHeader record;
+			memset(&record, 0, sizeof(record));
+			record.fileSize = fileSize;
+			record.headerSize = sosOffset;
+			record.fingerprint = xxh3Hash64(file + sosOffset, fileSize - sosOffset);
+			record.pathLength = path.length();
+			
+			unique_lock<mutex> guard(lock);
+			if(error == 0 && !(	writeAll(fd, &record, sizeof(record)) && writeAll(fd, path.data(), path.length()) &&
+								writeAll(fd, file, sosOffset)))
+				error = (errno != 0) ? errno : EIO;
+			unsigned long recordNumber = ++recordsWritten;
+			
+			// Wait until a sync started after this record was written has finished; the worker
+			// that finds no sync running syncs every record written so far
+			// Once a write or sync fails, no later record is reported as on disk
+			while(error == 0 && recordsSynced < recordNumber){
+				if(syncing){
+					syncDone.wait(guard);
+					continue;
+				}
+				
+				syncing = true;
+				unsigned long syncRecords = recordsWritten;
+				guard.unlock();
+				bool synced = (fdatasync(fd) == 0);
+				int syncError = errno;
+				guard.lock();
+				syncing = false;
+				if(synced)
+					recordsSynced = syncRecords;
+				else if(error == 0)
+					error = syncError;
+				syncDone.notify_all();
+			}
+			
+			errno = error;
+			return error == 0;
+		}
+};
+
+// Reads every record of an undo log; returns false if the file is not an undo log
+// A record cut short (the run was interrupted while writing it) is ignored, since its file
+// was not overwritten
+bool readUndoLog(string filepath, vector<UndoRecord>& records){
+	FILE* log = fopen(filepath.c_str(), "rb");
+	if(log == NULL)
+		return false;
+	
+	UndoLogHeader header;
+	if(	fread(&header, sizeof(header), 1, log) != 1 || memcmp(header.magic, undoMagic, sizeof(undoMagic)) != 0 ||
+		header.byteOrder != undoByteOrder || header.hash != undoXXH3){
+		fclose(log);
+		return false;
+	}
+	
+	struct stat st;
+	if(fstat(fileno(log), &st) != 0){
+		fclose(log);
+		return false;
+	}
+	
+	// Sizes are checked against the rest of the log before anything is allocated, so a corrupt
+	// record ends the log like a cut short one
+	UndoRecordHeader recordHeader;
+	while(fread(&recordHeader, sizeof(recordHeader), 1, log) == 1){
+		unsigned long long remaining = st.st_size - ftell(log);
+		if(	recordHeader.pathLength == 0 || recordHeader.pathLength > PATH_MAX || recordHeader.pathLength > remaining ||
+			recordHeader.headerSize > recordHeader.fileSize || recordHeader.headerSize > remaining - recordHeader.pathLength)
+			break;
+		
+		UndoRecord record;
+		record.fileSize = recordHeader.fileSize;
+		record.fingerprint = recordHeader.fingerprint;
+		record.path.resize(recordHeader.pathLength);
+		record.header.resize(recordHeader.headerSize);
+		if(	fread(&record.path[0], 1, recordHeader.pathLength, log) != recordHeader.pathLength ||
+			fread(record.header.data(), 1, recordHeader.headerSize, log) != recordHeader.headerSize)
+			break;
+		records.push_back(record);
+	}
+	
+	fclose(log);
+	return true;
+}
@@ -0,0 +1,38 @@
+#include<string>
+
+using namespace std;
+
+// XMP Namespaces
+const string xmpMetaNS = "adobe:ns:meta/";
+const string rdfNS = "http://www.w3.org/1999/02/22-rdf-syntax-ns#";
+const string exifNS = "http://ns.adobe.com/exif/1.0/";
+
+// XMP packet wrapper; begin holds the UTF-8 byte order mark, and the id is fixed by the XMP specification
+const string xpacketBegin = "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n";
+const string xpacketEnd = "<?xpacket end=\"w\"?>\n";
+
+// Returns an XMP rational as a string ("numerator/denominator")
+string xmpRational(int numerator, int denominator){
+	return to_string(numerator) + "/" + to_string(denominator);
+}
+
+// Returns an XMP sidecar packet containing the same metadata as the APP1 segment
+// Aperture and shutter speed are the XML values (see documentation), and are stored
+// as the same rationals used in the EXIF IFD:
+// FNumber = (XML-value)/10, ExposureTime = 10/(XML-value)
+// A shutter speed of 0 (unknown) has no valid rational, so ExposureTime is left out
+string xmpPacket(int aperture, int shutterSpeed){
+	string xmp = xpacketBegin;
+	xmp.append("<x:xmpmeta xmlns:x=\"" + xmpMetaNS + "\">\n");
+	xmp.append("\t<rdf:RDF xmlns:rdf=\"" + rdfNS + "\">\n");
+	xmp.append("\t\t<rdf:Description rdf:about=\"\" xmlns:exif=\"" + exifNS + "\">\n");
+	xmp.append("\t\t\t<exif:FNumber>" + xmpRational(aperture, 10) + "</exif:FNumber>\n");
+	if(shutterSpeed > 0)
+		xmp.append("\t\t\t<exif:ExposureTime>" + xmpRational(10, shutterSpeed) + "</exif:ExposureTime>\n");
+	xmp.append("\t\t</rdf:Description>\n");
+	xmp.append("\t</rdf:RDF>\n");
+	xmp.append("</x:xmpmeta>\n");
+	xmp.append(xpacketEnd);
+
+	return xmp;
+}
@@ -0,0 +1,22 @@
+#include<string>
+
+using namespace std;
+
+struct Frame{
+	int frameNumber;
+	// aperture and shutterSpeed are stored as strings as they do not need to be evaluated on,
+	// and are therefore easier to write to XML
+	string aperture;
+	string shutterSpeed;
+};
+
+string frameToXml(Frame exposure){
+	
+	string xml = "\t<exp>\n";
+	xml.append("\t\t<frameNumber>" + to_string(exposure.frameNumber) + "</frameNumber>\n");
+	xml.append("\t\t<aperture>" + exposure.aperture + "</aperture>\n");
+	xml.append("\t\t<shutterSpeed>" + exposure.shutterSpeed + "</shutterSpeed>\n");
+	xml.append("\t</exp>\n");
+	
+	return xml;
+}
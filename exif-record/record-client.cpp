@@ -0,0 +1,153 @@
+#include<iostream>
+#include<string>
+#include<vector>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<chrono>
+#include<algorithm>
+#include<cstring>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+
+using namespace std;
+
+// Test client for the recorder service (xml-gen --daemon)
+// Each camera sends frames over its own connection as fast as the recorder acknowledges
+// them (with up to <window> frames waiting), then the throughput and acknowledgement
+// latency are printed
+
+typedef chrono::steady_clock Clock;
+
+// Frames sent and acknowledged by one camera
+struct CameraRun{
+	string cameraID;
+	vector<Clock::time_point> sent;
+	vector<double> latency;		// Milliseconds from send to acknowledgement
+	int errors = 0;
+};
+
+// Opens a connection to the recorder socket; returns -1 on failure
+int connectRecorder(string socketPath){
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+	
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	if(connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0){
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+// Sends frames for one camera and records the latency of each acknowledgement
+void runCamera(string socketPath, CameraRun& run, int frames, int window){
+	int fd = connectRecorder(socketPath);
+	if(fd < 0){
+		perror("Could not connect to recorder");
+		run.errors = frames;
+		return;
+	}
+	
+	run.sent.resize(frames);
+	run.latency.resize(frames);
+	mutex lock;
+	condition_variable acked;
+	int ackCount = 0;
+	
+	// Acknowledgements are received in the order the frames were sent
+	thread receiver([&](){
+		string buffer;
+		char buf[4096];
+		ssize_t n;
+		int received = 0;
+		while(received < frames && (n = recv(fd, buf, sizeof(buf), 0)) > 0){
+			Clock::time_point now = Clock::now();
+			buffer.append(buf, n);
+			
+			size_t start = 0, end;
+			while((end = buffer.find('\n', start)) != string::npos){
+				if(buffer.compare(start, 3, "OK ") != 0)
+					run.errors++;
+				run.latency.at(received) = chrono::duration<double, milli>(now - run.sent.at(received)).count();
+				received++;
+				start = end + 1;
+			}
+			buffer.erase(0, start);
+			
+			lock_guard<mutex> guard(lock);
+			ackCount = received;
+			acked.notify_one();
+		}
+	});
+	
+	const int apertures[] = {14, 20, 28, 40, 56, 80, 110, 160, 220};
+	const int shutterSpeeds[] = {10000, 5000, 2500, 1250, 600, 300, 150, 80, 40, 20, 10};
+	for(int i = 0; i < frames; i++){
+		{
+			unique_lock<mutex> guard(lock);
+			acked.wait(guard, [&]{ return i - ackCount < window; });
+		}
+		
+		string line = run.cameraID + " " + to_string(apertures[i % 9]) + " " + to_string(shutterSpeeds[i % 11]) + "\n";
+		run.sent.at(i) = Clock::now();
+		if(send(fd, line.data(), line.size(), MSG_NOSIGNAL) != (ssize_t)line.size()){
+			perror("Could not send frame");
+			shutdown(fd, SHUT_RDWR);		// Stops the receiver waiting for acknowledgements that will not come
+			break;
+		}
+	}
+	
+	receiver.join();
+	close(fd);
+}
+
+// Returns the latency at a percentile (0 to 1) of sorted latencies
+double percentile(vector<double>& sorted, double p){
+	if(sorted.empty())
+		return 0;
+	return sorted.at(min(sorted.size() - 1, (size_t)(p * sorted.size())));
+}
+
+int main(int argc, char* argv[]){
+	if(argc < 3){
+		cout << "Usage: <socket-path> <frames-per-camera> [<cameras>] [<window>]" << endl;
+		return 0;
+	}
+	string socketPath = argv[1];
+	int frames = atoi(argv[2]);
+	int cameras = (argc > 3) ? atoi(argv[3]) : 1;
+	int window = (argc > 4) ? atoi(argv[4]) : 64;
+	
+	vector<CameraRun> runs(cameras);
+	vector<thread> threads;
+	Clock::time_point start = Clock::now();
+	for(int c = 0; c < cameras; c++){
+		runs.at(c).cameraID = "bench" + to_string(c);
+		threads.push_back(thread(runCamera, socketPath, ref(runs.at(c)), frames, window));
+	}
+	for(int c = 0; c < cameras; c++)
+		threads.at(c).join();
+	double seconds = chrono::duration<double>(Clock::now() - start).count();
+	
+	vector<double> latency;
+	int errors = 0;
+	for(int c = 0; c < cameras; c++){
+		latency.insert(latency.end(), runs.at(c).latency.begin(), runs.at(c).latency.end());
+		errors += runs.at(c).errors;
+	}
+	sort(latency.begin(), latency.end());
+	
+	printf("%d frames from %d cameras in %.3fs (%.0f frames/s), %d errors\n", frames * cameras, cameras, seconds,
+		(frames * cameras) / seconds, errors);
+	printf("Acknowledgement latency: p50 %.3fms, p99 %.3fms, max %.3fms\n", percentile(latency, 0.5),
+		percentile(latency, 0.99), latency.empty() ? 0 : latency.back());
+	
+	return 0;
+}
@@ -0,0 +1,382 @@
+#include<string>
+#include<map>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<cstring>
+#include<csignal>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<sys/un.h>
+
+#include "frame.h"
+
+using namespace std;
+
+// Recorder service
+// Frames are sent over a Unix domain socket, one per line:
+//		<camera-id> <aperture> <shutter-speed>
+// Aperture and shutter speed are the XML values (see documentation). Each camera has its
+// own roll file (<roll-directory>/<camera-id>.xml), and frames are numbered in the order
+// they are received. Each line is answered in order, once the frame is on disk:
+//		OK <camera-id> <frame-number>
+//		ERR <message>
+//
+// Frames for a roll are written in batches; while one batch is being synced to disk, the
+// frames that arrive are collected into the next batch, so a frame waits for at most two syncs
+
+const string rollEndTag = "</roll>";
+const int recorderBacklog = 64;		// Pending connections on the socket
+const size_t maxLineLength = 256;		// Longest frame line; clients sending longer lines are dropped
+
+// Roll file for one camera
+// The file is always a complete XML file; each batch overwrites the closing tag with the
+// new frames followed by a new closing tag
+class Roll{
+	private:
+		int fd;
+		off_t endOffset;				// Offset of the closing roll tag
+		int frameCount;
+		string pending;					// Frames not yet written
+		unsigned long pendingSeq;		// Sequence number of the last frame added
+		unsigned long durableSeq;		// Sequence number of the last frame written (or failed)
+		unsigned long failedSeq;		// Sequence number of the first frame that could not be written
+		mutex lock;
+		condition_variable pendingChanged;
+		condition_variable durableChanged;
+		thread writer;
+		
+		// Writes batches of pending frames to disk until the recorder exits
+		void writeBatches(){
+			unique_lock<mutex> guard(lock);
+			while(true){
+				pendingChanged.wait(guard, [this]{ return !pending.empty(); });
+				
+				// Take the batch; frames that arrive while it is written go into the next batch
+				string batch = pending + rollEndTag + "\n";
+				unsigned long batchStart = durableSeq + 1;
+				unsigned long batchSeq = pendingSeq;
+				bool rollFailed = (failedSeq != 0);
+				pending.clear();
+				guard.unlock();
+				
+				bool written = !rollFailed && pwrite(fd, batch.data(), batch.size(), endOffset) == (ssize_t)batch.size() &&
+					fdatasync(fd) == 0;
+				if(written)
+					endOffset += batch.size() - rollEndTag.length() - 1;
+				else if(!rollFailed)
+					perror("Could not write roll file");
+				
+				guard.lock();
+				if(!written && failedSeq == 0)
+					failedSeq = batchStart;
+				durableSeq = batchSeq;
+				durableChanged.notify_all();
+			}
+		}
+	
+	public:
+		Roll(){
+			fd = -1;
+			endOffset = 0;
+			frameCount = 0;
+			pendingSeq = 0;
+			durableSeq = 0;
+			failedSeq = 0;
+		}
+		
+		// Opens (or creates) a roll file; frame numbers continue from an existing roll
+		// A roll without a closing tag (eg. an interrupted interactive session) is continued
+		// after its last frame; anything else that is not a roll is refused, never overwritten
+		bool open(string filepath){
+			fd = ::open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+			if(fd < 0)
+				return false;
+			
+			// Read existing roll to find the closing tag and count the frames
+			string xml;
+			char buf[4096];
+			ssize_t n;
+			while((n = pread(fd, buf, sizeof(buf), xml.size())) > 0)
+				xml.append(buf, n);
+			if(n < 0){
+				close(fd);
+				return false;
+			}
+			
+			size_t end = xml.rfind(rollEndTag);
+			if(xml.empty()){
+				// New roll
+				string start = "<roll>\n" + rollEndTag + "\n";
+				if(pwrite(fd, start.data(), start.size(), 0) != (ssize_t)start.size() || fdatasync(fd) != 0){
+					close(fd);
+					return false;
+				}
+				end = start.find(rollEndTag);
+			}
+			else if(end == string::npos){
+				// No closing tag; it is added after the last frame (or the opening tag), as long as
+				// only whitespace follows
+				size_t insert = xml.rfind("</exp>");
+				if(insert != string::npos)
+					insert += strlen("</exp>");
+				else if((insert = xml.find("<roll>")) != string::npos)
+					insert += strlen("<roll>");
+				if(insert == string::npos || xml.find_first_not_of(" \t\r\n", insert) != string::npos){
+					fprintf(stderr, "%s is not a roll file or ends with an incomplete frame\n", filepath.c_str());
+					close(fd);
+					errno = EBADMSG;
+					return false;
+				}
+				
+				if(xml[insert] == '\n')
+					insert++;
+				string tag = (xml[insert - 1] == '\n' ? "" : "\n") + rollEndTag + "\n";
+				if(pwrite(fd, tag.data(), tag.size(), insert) != (ssize_t)tag.size() || fdatasync(fd) != 0){
+					close(fd);
+					return false;
+				}
+				end = insert + tag.size() - rollEndTag.length() - 1;
+			}
+			
+			endOffset = end;
+			for(size_t pos = xml.find("<exp>"); pos != string::npos; pos = xml.find("<exp>", pos + 1))
+				frameCount++;
+			
+			writer = thread(&Roll::writeBatches, this);
+			writer.detach();
+			return true;
+		}
+		
+		// Adds a frame to the next batch; returns the frame number and sequence number to wait on
+		int addFrame(string aperture, string shutterSpeed, unsigned long& seq){
+			lock_guard<mutex> guard(lock);
+			
+			Frame exposure;
+			exposure.frameNumber = frameCount++;
+			exposure.aperture = aperture;
+			exposure.shutterSpeed = shutterSpeed;
+			pending.append(frameToXml(exposure));
+			
+			seq = ++pendingSeq;
+			pendingChanged.notify_one();
+			return exposure.frameNumber;
+		}
+		
+		// Waits until the frame with sequence number seq has been written
+		void waitDurable(unsigned long seq){
+			unique_lock<mutex> guard(lock);
+			durableChanged.wait(guard, [this, seq]{ return durableSeq >= seq; });
+		}
+		
+		// Returns 1 if the frame with sequence number seq is on disk, 0 if it has not been
+		// written yet, or -1 if it could not be written
+		// Once a batch fails, the roll is not written again
+		int getStatus(unsigned long seq){
+			lock_guard<mutex> guard(lock);
+			if(seq > durableSeq)
+				return 0;
+			return (failedSeq != 0 && seq >= failedSeq) ? -1 : 1;
+		}
+};
+
+// Frame that has been added to a roll, waiting for its reply
+struct PendingReply{
+	Roll* roll;
+	unsigned long seq;
+	string reply;
+};
+
+class Recorder{
+	private:
+		string rollDirectory;
+		map<string, Roll*> rolls;
+		mutex rollsLock;
+		
+		// Returns the roll for a camera, opening it on first use
+		Roll* getRoll(string cameraID){
+			lock_guard<mutex> guard(rollsLock);
+			if(rolls.count(cameraID) == 0){
+				Roll* roll = new Roll();
+				if(!roll->open(rollDirectory + "/" + cameraID + ".xml")){
+					perror("Could not open roll file");
+					delete roll;
+					return NULL;
+				}
+				rolls[cameraID] = roll;
+			}
+			return rolls[cameraID];
+		}
+		
+		// Returns true if a string is a positive integer (XML value)
+		static bool isXmlValue(string value){
+			return !value.empty() && value.length() < 10 && value.find_first_not_of("0123456789") == string::npos &&
+				value.find_first_not_of("0") != string::npos;
+		}
+		
+		// Returns true if a camera ID can be used as a filename
+		static bool isCameraID(string cameraID){
+			return !cameraID.empty() && cameraID.length() <= 64 &&
+				cameraID.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") == string::npos;
+		}
+		
+		// Writes a whole string to a socket
+		static bool sendAll(int fd, string data){
+			size_t total = 0;
+			while(total < data.size()){
+				ssize_t n = send(fd, data.data() + total, data.size() - total, MSG_NOSIGNAL);
+				if(n <= 0)
+					return false;
+				total += n;
+			}
+			return true;
+		}
+		
+		// Sends replies in order, each once its frame is on disk
+		// Replies that are ready together are sent with one write
+		static void sendReplies(int fd, deque<PendingReply>& replies, mutex& repliesLock,
+				condition_variable& repliesChanged, bool& closed){
+			unique_lock<mutex> guard(repliesLock);
+			while(true){
+				repliesChanged.wait(guard, [&]{ return !replies.empty() || closed; });
+				if(replies.empty())
+					return;
+				
+				// Wait for the oldest frame to be on disk
+				PendingReply oldest = replies.front();
+				guard.unlock();
+				if(oldest.roll != NULL)
+					oldest.roll->waitDurable(oldest.seq);
+				guard.lock();
+				
+				// Every reply (in order) up to the first frame not yet on disk
+				string batch;
+				while(!replies.empty()){
+					PendingReply reply = replies.front();
+					int status = (reply.roll == NULL) ? 1 : reply.roll->getStatus(reply.seq);
+					if(status == 0)
+						break;
+					
+					batch.append(status > 0 ? reply.reply : "ERR could not write roll file\n");
+					replies.pop_front();
+				}
+				
+				guard.unlock();
+				sendAll(fd, batch);
+				guard.lock();
+			}
+		}
+		
+		// Handles one client connection; each line is a frame
+		void serveClient(int fd){
+			deque<PendingReply> replies;
+			mutex repliesLock;
+			condition_variable repliesChanged;
+			bool closed = false;
+			thread replier(sendReplies, fd, ref(replies), ref(repliesLock), ref(repliesChanged), ref(closed));
+			
+			string buffer;
+			char buf[4096];
+			ssize_t n;
+			while((n = recv(fd, buf, sizeof(buf), 0)) > 0){
+				buffer.append(buf, n);
+				
+				size_t start = 0, end;
+				while((end = buffer.find('\n', start)) != string::npos){
+					PendingReply reply = handleLine(buffer.substr(start, end - start));
+					start = end + 1;
+					
+					lock_guard<mutex> guard(repliesLock);
+					replies.push_back(reply);
+					repliesChanged.notify_one();
+				}
+				buffer.erase(0, start);
+				
+				// The rest of the buffer is an incomplete line
+				if(buffer.size() > maxLineLength){
+					PendingReply reply;
+					reply.roll = NULL;
+					reply.seq = 0;
+					reply.reply = "ERR line too long\n";
+					
+					lock_guard<mutex> guard(repliesLock);
+					replies.push_back(reply);
+					break;
+				}
+			}
+			
+			{
+				lock_guard<mutex> guard(repliesLock);
+				closed = true;
+				repliesChanged.notify_one();
+			}
+			replier.join();
+			close(fd);
+		}
+		
+		// Parses a frame line and adds the frame to its roll
+		PendingReply handleLine(string line){
+			PendingReply reply;
+			reply.roll = NULL;
+			reply.seq = 0;
+			
+			char cameraID[128], aperture[16], shutterSpeed[16];
+			if(	sscanf(line.c_str(), "%127s %15s %15s", cameraID, aperture, shutterSpeed) != 3 ||
+				!isCameraID(cameraID) || !isXmlValue(aperture) || !isXmlValue(shutterSpeed)){
+				reply.reply = "ERR expected <camera-id> <aperture> <shutter-speed>\n";
+				return reply;
+			}
+			
+			Roll* roll = getRoll(cameraID);
+			if(roll == NULL){
+				reply.reply = "ERR could not open roll file\n";
+				return reply;
+			}
+			
+			int frameNumber = roll->addFrame(aperture, shutterSpeed, reply.seq);
+			reply.roll = roll;
+			reply.reply = "OK " + string(cameraID) + " " + to_string(frameNumber) + "\n";
+			return reply;
+		}
+	
+	public:
+		Recorder(string directory){
+			rollDirectory = directory;
+		}
+		
+		// Listens on a Unix domain socket and serves clients until the process is stopped
+		// Returns only if the socket could not be created
+		bool run(string socketPath){
+			int server = socket(AF_UNIX, SOCK_STREAM, 0);
+			if(server < 0)
+				return false;
+			
+			struct sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if(socketPath.length() >= sizeof(address.sun_path)){
+				errno = ENAMETOOLONG;
+				return false;
+			}
+			strcpy(address.sun_path, socketPath.c_str());
+			
+			unlink(socketPath.c_str());
+			if(bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server, recorderBacklog) != 0)
+				return false;
+			
+			signal(SIGPIPE, SIG_IGN);
+			while(true){
+				int client = accept(server, NULL, NULL);
+				if(client < 0){
+					if(errno == EINTR)
+						continue;
+					return false;
+				}
+				
+				thread(&Recorder::serveClient, this, client).detach();
+			}
+		}
+};
@@ -3,28 +3,27 @@
 #include<sstream>
 #include<string>
 
-using namespace std;
+#include "recorder.h"
 
-struct Frame{
-	int frameNumber;
-	// aperture and shutterSpeed are stored as strings as they do not need to be evaluated on,
-	// and are therefore easier to write to XML
-	string aperture;
-	string shutterSpeed;
-};
+using namespace std;
 
-string frameToXml(Frame exposure){
-	
-	string xml = "\t<exp>\n";
-	xml.append("\t\t<frameNumber>" + to_string(exposure.frameNumber) + "</frameNumber>\n");
-	xml.append("\t\t<aperture>" + exposure.aperture + "</aperture>\n");
-	xml.append("\t\t<shutterSpeed>" + exposure.shutterSpeed + "</shutterSpeed>\n");
-	xml.append("\t</exp>\n");
+int main(int argc, char* argv[]){
 	
-	return xml;
-}
-
-int main(){
+	// Recorder service mode; frames are received over a Unix domain socket instead of
+	// entered manually
+	if(argc > 1 && string(argv[1]) == "--daemon"){
+		if(argc < 3 || argc > 4){
+			cout << "Usage: --daemon <socket-path> [<roll-directory>]" << endl;
+			return 0;
+		}
+		
+		Recorder recorder(argc == 4 ? argv[3] : ".");
+		cout << "Recording frames from " << argv[2] << endl;
+		recorder.run(argv[2]);
+		
+		perror("Could not listen on socket");
+		return 1;
+	}
 	
 	// Welcome message
 	cout << "===[ film-exif Metadata Recording Tool ]===" << endl;